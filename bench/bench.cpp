@@ -0,0 +1,479 @@
+#ifdef _WIN32
+    #define SDL_MAIN_HANDLED
+#endif
+
+#include "resource.hpp"
+#include "world.hpp"
+#include "engine.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <algorithm>
+
+/*
+ * Standalone benchmark harness for the engine hot paths
+ * Usage: ./game-bench [--filter substring] [--json path] [--min-time seconds]
+ * Run it from the repo root so the shaders and resources can be found. With no display, SDL_VIDEODRIVER=offscreen gives a headless GL context
+ */
+
+typedef void (*BenchmarkFunction)(unsigned long iterations);
+
+struct Benchmark {
+    const char* name;
+    BenchmarkFunction function;
+    // Work items per iteration, used to report items per second
+    unsigned long items;
+};
+
+struct BenchmarkResult {
+    const char* name;
+    unsigned long iterations;
+    double median_ns;
+    double min_ns;
+    double items_per_second;
+};
+
+static const unsigned int REPETITIONS = 5;
+
+// Keeps the compiler from optimizing away a result the benchmark doesn't otherwise use
+template<typename T>
+static inline void do_not_optimize(const T& value) {
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+static double now_seconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* CPU benchmarks */
+
+static World* world = nullptr;
+
+static void bench_map_get_tile(unsigned long iterations) {
+    for (unsigned long i = 0; i < iterations; i++) {
+        ivec2 coordinate = ivec2(i % World::MAP_WIDTH, (i / World::MAP_WIDTH) % World::MAP_WIDTH);
+        Tile tile = world->map_get_tile(coordinate);
+        do_not_optimize(tile);
+    }
+}
+
+static void bench_map_to_world(unsigned long iterations) {
+    for (unsigned long i = 0; i < iterations; i++) {
+        vec2 position = world->map_to_world(ivec2(i & 255, (i >> 8) & 255));
+        do_not_optimize(position);
+    }
+}
+
+static const unsigned int ANIMATION_COUNT = 100000;
+
+static void bench_sprite_animation_update(unsigned long iterations) {
+    static Sprite sprite;
+    static std::vector<SpriteAnimation> animations;
+    if (animations.empty()) {
+        sprite.register_animation(ANT_ANIMATION_IDLE, 3, { ivec2(1, 1), ivec2(2, 1) });
+        sprite.register_animation(ANT_ANIMATION_WALK, 10, { ivec2(3, 1), ivec2(4, 1), ivec2(5, 1), ivec2(6, 1) });
+        animations.resize(ANIMATION_COUNT, SpriteAnimation(&sprite));
+    }
+
+    for (unsigned long i = 0; i < iterations; i++) {
+        for (SpriteAnimation& animation : animations) {
+            animation.update(ANT_ANIMATION_WALK, 1.0f / 60.0f);
+        }
+        do_not_optimize(animations[0].frame);
+    }
+}
+
+static const unsigned int WORLD_CRITTER_COUNT = 10000;
+
+static void add_world_critters() {
+    while (world->critters.size() < WORLD_CRITTER_COUNT) {
+        unsigned int index = world->critters.size();
+        world->critters.push_back((Critter) {
+            .position = vec2((float)(index % 640), (float)((index / 640) % 360)),
+            .animation = SpriteAnimation(&ant_sprite),
+            .selected = false
+        });
+    }
+}
+
+static void bench_world_update(unsigned long iterations) {
+    add_world_critters();
+    for (unsigned long i = 0; i < iterations; i++) {
+        world->update();
+        world->swap_snapshots();
+    }
+}
+
+/* GL benchmarks, timed until the GPU has finished the submitted work */
+
+static void bench_render_sprite(unsigned long iterations) {
+    Engine& engine = Engine::instance();
+    engine.render_clear();
+    for (unsigned long i = 0; i < iterations; i++) {
+        engine.render_sprite(tileset, vec2((float)(i % 608), (float)((i / 608) % 328)), 14, 1);
+    }
+    engine.render_flush();
+    glFinish();
+}
+
+static void bench_render_text(unsigned long iterations) {
+    Engine& engine = Engine::instance();
+    engine.render_clear();
+    for (unsigned long i = 0; i < iterations; i++) {
+        engine.render_text(font_small, "The quick brown fox jumps over the lazy dog", vec2(0.0f, (float)(i % 340)), COLOR_WHITE);
+    }
+    engine.render_flush();
+    glFinish();
+}
+
+// Each iteration one light, drawn into the lightmap by render_flip() a full frame of lights at a time
+static void bench_render_light(unsigned long iterations) {
+    Engine& engine = Engine::instance();
+    engine.set_lighting_enabled(true);
+    engine.render_clear();
+    for (unsigned long i = 0; i < iterations; i++) {
+        engine.render_light(vec2((float)(i % 640), (float)((i / 640) % 360)), 32.0f, COLOR_WHITE);
+        if ((i + 1) % Engine::MAX_LIGHTS == 0) {
+            engine.render_flip();
+            engine.render_clear();
+        }
+    }
+    engine.render_flip();
+    glFinish();
+    engine.set_lighting_enabled(false);
+}
+
+static const unsigned int PARTICLE_EMITTER_COUNT = 8;
+static const unsigned int PARTICLE_COUNT = 40000;
+
+// Emitters full of particles spread over the screen that outlive the benchmark, so every update moves all of them
+static ParticleSystem& bench_particle_system() {
+    static ParticleSystem particles;
+    static bool filled = false;
+    if (!filled) {
+        ParticleEmitterSettings settings = (ParticleEmitterSettings) {
+            .sprite = &particle_sprite,
+            .frame = ivec2(0, 0),
+            .rate = 0.0f,
+            .lifetime = 1e9f,
+            .spawn_extent = vec2(320.0f, 180.0f),
+            .velocity_min = vec2(-20.0f, -20.0f),
+            .velocity_max = vec2(20.0f, 20.0f),
+            .acceleration = vec2(0.0f, 10.0f),
+            .capacity = PARTICLE_COUNT / PARTICLE_EMITTER_COUNT
+        };
+        for (unsigned int i = 0; i < PARTICLE_EMITTER_COUNT; i++) {
+            unsigned int emitter;
+            particles.create_emitter(settings, vec2(320.0f, 180.0f), &emitter);
+            particles.burst(emitter, settings.capacity);
+        }
+        filled = true;
+    }
+
+    return particles;
+}
+
+static void bench_particle_update(unsigned long iterations) {
+    ParticleSystem& particles = bench_particle_system();
+    for (unsigned long i = 0; i < iterations; i++) {
+        particles.update(1.0f / 60.0f);
+    }
+    do_not_optimize(particles.particle_count());
+}
+
+// Each iteration every particle, one instanced draw for all the emitters
+static void bench_particle_render(unsigned long iterations) {
+    Engine& engine = Engine::instance();
+    ParticleSystem& particles = bench_particle_system();
+    engine.render_clear();
+    for (unsigned long i = 0; i < iterations; i++) {
+        particles.render();
+    }
+    glFinish();
+}
+
+// Draws selected critters, each iteration one sprite. The 8 tap shader is what critters used before outline masks
+static void render_outlined_sprites(Shader shader, unsigned long iterations) {
+    Engine& engine = Engine::instance();
+    engine.render_clear();
+    engine.use_shader(shader);
+    engine.set_shader_uniform("show_outline", true);
+    for (unsigned long i = 0; i < iterations; i++) {
+        engine.render_sprite(ant_sprite, vec2((float)(i % 608), (float)((i / 608) % 328)), 3, 1);
+    }
+    engine.render_flush();
+    glFinish();
+}
+
+static void bench_render_outline_8_tap(unsigned long iterations) {
+    static Shader shader = 0;
+    if (shader == 0) {
+        Engine& engine = Engine::instance();
+        engine.load_shader(&shader, "./shader/sprite.vs.glsl", "./shader/outline.fs.glsl");
+        engine.use_shader(shader);
+        engine.set_shader_uniform("sprite_texture", 0);
+        engine.set_shader_uniform("palette_texture", 1);
+    }
+    render_outlined_sprites(shader, iterations);
+}
+
+static void bench_render_outline_mask(unsigned long iterations) {
+    render_outlined_sprites(outline_shader, iterations);
+}
+
+static void bench_text_layout_build(unsigned long iterations) {
+    static TextLayout layout;
+    for (unsigned long i = 0; i < iterations; i++) {
+        layout.build(font_small, "The quick brown fox jumps over the lazy dog", TEXT_ALIGN_LEFT, 0, 0);
+        do_not_optimize(layout.size);
+    }
+}
+
+static void bench_text_layout_cache_hit(unsigned long iterations) {
+    static TextLayoutCache cache;
+    for (unsigned long i = 0; i < iterations; i++) {
+        const TextLayout& layout = cache.get(font_small, "The quick brown fox jumps over the lazy dog", TEXT_ALIGN_LEFT, 0, 0);
+        do_not_optimize(layout.size);
+    }
+}
+
+static void bench_world_render(unsigned long iterations) {
+    Engine& engine = Engine::instance();
+    world->critters.clear();
+    world->update();
+    world->swap_snapshots();
+    for (unsigned long i = 0; i < iterations; i++) {
+        engine.render_clear();
+        world->render();
+    }
+    engine.render_flush();
+    glFinish();
+}
+
+static void bench_world_render_critters(unsigned long iterations) {
+    Engine& engine = Engine::instance();
+    add_world_critters();
+    world->update();
+    world->swap_snapshots();
+    for (unsigned long i = 0; i < iterations; i++) {
+        engine.render_clear();
+        world->render();
+    }
+    engine.render_flush();
+    glFinish();
+}
+
+// An idle scene in retained mode, where nothing changes between frames so every draw is culled
+static void render_world_retained(unsigned long iterations) {
+    Engine& engine = Engine::instance();
+    engine.set_retained_mode(true);
+    for (unsigned long i = 0; i < iterations; i++) {
+        world->invalidate_changes();
+        engine.render_clear();
+        world->render();
+    }
+    engine.render_flush();
+    glFinish();
+    engine.set_retained_mode(false);
+}
+
+static void bench_world_render_retained(unsigned long iterations) {
+    world->critters.clear();
+    world->update();
+    world->swap_snapshots();
+    render_world_retained(iterations);
+}
+
+static void bench_world_render_critters_retained(unsigned long iterations) {
+    add_world_critters();
+    world->update();
+    world->swap_snapshots();
+    render_world_retained(iterations);
+}
+
+static void bench_font_load(unsigned long iterations) {
+    for (unsigned long i = 0; i < iterations; i++) {
+        Font font;
+        font.load("./res/hack.ttf", 10);
+        font.unload();
+    }
+}
+
+static void bench_font_load_sdf(unsigned long iterations) {
+    for (unsigned long i = 0; i < iterations; i++) {
+        Font font;
+        font.load("./res/hack.ttf", 24, Font::RENDERING_SDF);
+        font.unload();
+    }
+}
+
+static void bench_sprite_load(unsigned long iterations) {
+    for (unsigned long i = 0; i < iterations; i++) {
+        Sprite sprite;
+        sprite.load("./res/tiles.png", Sprite::SPECIFY_FRAME_SIZE, 32, 32);
+        sprite.unload();
+    }
+}
+
+static void bench_sprite_load_palette(unsigned long iterations) {
+    for (unsigned long i = 0; i < iterations; i++) {
+        Sprite sprite;
+        sprite.load("./res/tiles.png", Sprite::SPECIFY_FRAME_SIZE, 32, 32, true);
+        sprite.unload();
+    }
+}
+
+// Streams the tileset to completion, one update per simulated frame. Compare against Sprite::load for the cost of spreading the upload out
+static void bench_texture_streamer_load_sprite(unsigned long iterations) {
+    TextureStreamer& streamer = Engine::instance().texture_streamer;
+    for (unsigned long i = 0; i < iterations; i++) {
+        Sprite sprite;
+        streamer.load_sprite(&sprite, "./res/tiles.png", Sprite::SPECIFY_FRAME_SIZE, 32, 32);
+        while (!streamer.idle()) {
+            streamer.update();
+        }
+        sprite.unload();
+    }
+    glFinish();
+}
+
+static const Benchmark BENCHMARKS[] = {
+    { "World::map_get_tile", bench_map_get_tile, 1 },
+    { "World::map_to_world", bench_map_to_world, 1 },
+    { "SpriteAnimation::update/100000", bench_sprite_animation_update, ANIMATION_COUNT },
+    { "World::update/10000_critters", bench_world_update, WORLD_CRITTER_COUNT },
+    { "Engine::render_sprite", bench_render_sprite, 1 },
+    { "Engine::render_sprite/outline_8_tap", bench_render_outline_8_tap, 1 },
+    { "Engine::render_sprite/outline_mask", bench_render_outline_mask, 1 },
+    { "Engine::render_light", bench_render_light, 1 },
+    { "ParticleSystem::update/40000", bench_particle_update, PARTICLE_COUNT },
+    { "ParticleSystem::render/40000", bench_particle_render, PARTICLE_COUNT },
+    { "Engine::render_text/43_chars", bench_render_text, 43 },
+    { "TextLayout::build/43_chars", bench_text_layout_build, 43 },
+    { "TextLayoutCache::get/hit", bench_text_layout_cache_hit, 43 },
+    { "World::render/map", bench_world_render, 1 },
+    { "World::render/10000_critters", bench_world_render_critters, 1 },
+    { "World::render/map_retained", bench_world_render_retained, 1 },
+    { "World::render/10000_critters_retained", bench_world_render_critters_retained, 1 },
+    { "Font::load", bench_font_load, 1 },
+    { "Font::load/sdf", bench_font_load_sdf, 1 },
+    { "Sprite::load", bench_sprite_load, 1 },
+    { "Sprite::load/palette", bench_sprite_load_palette, 1 },
+    { "TextureStreamer::load_sprite", bench_texture_streamer_load_sprite, 1 }
+};
+
+/* Runner */
+
+static BenchmarkResult run_benchmark(const Benchmark& benchmark, double min_time) {
+    // Grow the iteration count until one run takes long enough to time reliably
+    unsigned long iterations = 1;
+    while (true) {
+        double start = now_seconds();
+        benchmark.function(iterations);
+        double elapsed = now_seconds() - start;
+        if (elapsed >= min_time || iterations >= (1ul << 40)) {
+            break;
+        }
+        double scale = elapsed > 0.0 ? std::min(std::max(min_time * 1.4 / elapsed, 2.0), 10.0) : 10.0;
+        iterations = (unsigned long)(iterations * scale);
+    }
+
+    double times[REPETITIONS];
+    for (unsigned int i = 0; i < REPETITIONS; i++) {
+        double start = now_seconds();
+        benchmark.function(iterations);
+        times[i] = ((now_seconds() - start) * 1e9) / (double)iterations;
+    }
+    std::sort(times, times + REPETITIONS);
+
+    return (BenchmarkResult) {
+        .name = benchmark.name,
+        .iterations = iterations,
+        .median_ns = times[REPETITIONS / 2],
+        .min_ns = times[0],
+        .items_per_second = (double)benchmark.items * 1e9 / times[REPETITIONS / 2]
+    };
+}
+
+static bool write_json(const char* path, const std::vector<BenchmarkResult>& results) {
+    FILE* file = fopen(path, "w");
+    if (file == nullptr) {
+        printf("Error opening %s for writing\n", path);
+        return false;
+    }
+
+    char date[64];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"context\": {\n");
+    fprintf(file, "    \"date\": \"%s\",\n", date);
+    fprintf(file, "    \"repetitions\": %u,\n", REPETITIONS);
+    fprintf(file, "    \"worker_count\": %u\n", Engine::instance().jobs.worker_count());
+    fprintf(file, "  },\n");
+    fprintf(file, "  \"benchmarks\": [\n");
+    for (unsigned int i = 0; i < results.size(); i++) {
+        const BenchmarkResult& result = results[i];
+        fprintf(file, "    {\n");
+        fprintf(file, "      \"name\": \"%s\",\n", result.name);
+        fprintf(file, "      \"iterations\": %lu,\n", result.iterations);
+        fprintf(file, "      \"real_time\": %.3f,\n", result.median_ns);
+        fprintf(file, "      \"min_time\": %.3f,\n", result.min_ns);
+        fprintf(file, "      \"time_unit\": \"ns\",\n");
+        fprintf(file, "      \"items_per_second\": %.1f\n", result.items_per_second);
+        fprintf(file, "    }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+    fclose(file);
+
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* filter = nullptr;
+    const char* json_path = nullptr;
+    double min_time = 0.2;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            min_time = atof(argv[++i]);
+        }
+    }
+
+    Engine& engine = Engine::instance();
+    if (!engine.init("Critter Farm Benchmark", 640, 360, true) || !resource_init()) {
+        printf("Engine failed to start, GL benchmarks need a display or SDL_VIDEODRIVER=offscreen\n");
+        return 1;
+    }
+    engine.set_frame_limiter(false);
+    world = new World();
+
+    std::vector<BenchmarkResult> results;
+    printf("%-36s %14s %14s %12s %16s\n", "Benchmark", "Median ns", "Min ns", "Iterations", "Items/s");
+    for (const Benchmark& benchmark : BENCHMARKS) {
+        if (filter != nullptr && strstr(benchmark.name, filter) == nullptr) {
+            continue;
+        }
+
+        BenchmarkResult result = run_benchmark(benchmark, min_time);
+        printf("%-36s %14.1f %14.1f %12lu %16.0f\n", result.name, result.median_ns, result.min_ns, result.iterations, result.items_per_second);
+        results.push_back(result);
+    }
+
+    if (json_path != nullptr && !write_json(json_path, results)) {
+        return 1;
+    }
+
+    delete world;
+    resource_quit();
+    return 0;
+}
\ No newline at end of file
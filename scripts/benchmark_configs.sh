@@ -0,0 +1,17 @@
+#!/bin/sh
+# Builds the game in each optimized configuration and runs the frame benchmark on each one
+# Usage: ./scripts/benchmark_configs.sh [frames]
+set -e
+
+FRAMES=${1:-600}
+cd "$(dirname "$0")/.."
+
+make debug
+make relwithdebinfo
+make release
+make pgo BENCHMARK_FRAMES="$FRAMES"
+
+for binary in game-debug game-relwithdebinfo game game-pgo; do
+    echo "== $binary"
+    ./$binary --benchmark "$FRAMES"
+done
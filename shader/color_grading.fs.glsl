@@ -0,0 +1,25 @@
+#version 410 core
+
+in vec2 texture_coordinate;
+out vec4 color;
+
+uniform sampler2D source_texture;
+// 16 slices of 16x16 laid out left to right, red across each slice, green down and blue picking the slice
+uniform sampler2D lut_texture;
+uniform float grading_strength;
+
+const float LUT_SIZE = 16.0;
+
+vec3 lut_texel(vec3 source, float slice) {
+    vec2 coordinate = vec2((slice * LUT_SIZE) + (source.r * (LUT_SIZE - 1.0)) + 0.5, (source.g * (LUT_SIZE - 1.0)) + 0.5);
+    return texture(lut_texture, coordinate / vec2(LUT_SIZE * LUT_SIZE, LUT_SIZE)).rgb;
+}
+
+void main() {
+    vec4 source = texture(source_texture, texture_coordinate);
+    // Red and green are filtered by the sampler, blue is blended between the two nearest slices by hand
+    float blue = source.b * (LUT_SIZE - 1.0);
+    float slice = floor(blue);
+    vec3 graded = mix(lut_texel(source.rgb, slice), lut_texel(source.rgb, min(slice + 1.0, LUT_SIZE - 1.0)), blue - slice);
+    color = vec4(mix(source.rgb, graded, grading_strength), source.a);
+}
\ No newline at end of file
@@ -0,0 +1,12 @@
+#version 410 core
+
+in vec2 texture_coordinate;
+flat in vec3 light_color;
+out vec4 color;
+
+// Single channel falloff, 1 at the center of the light and 0 at its radius
+uniform sampler2D sprite_texture;
+
+void main() {
+    color = vec4(light_color * texture(sprite_texture, texture_coordinate).r, 1.0);
+}
\ No newline at end of file
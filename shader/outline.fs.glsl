@@ -1,18 +1,42 @@
 #version 410 core
 
 in vec2 texture_coordinate;
+flat in float palette_lookup;
 out vec4 color;
 
 uniform vec2 source_position;
 uniform vec2 source_size;
 uniform sampler2D sprite_texture;
+uniform sampler2D palette_texture;
 
 uniform bool show_outline;
 
+vec4 palette_texel(vec2 coordinate) {
+    return texelFetch(palette_texture, ivec2(int(texture(sprite_texture, coordinate).r * 255.0 + 0.5), 0), 0);
+}
+
 void main() {
     vec2 texture_size = textureSize(sprite_texture, 0);
     vec2 pixel_size = vec2(1.0 / texture_size.x, 1.0 / texture_size.y);
 
+    // Palettized sprites take their own path, so sprites with direct colors don't pay for the palette reads
+    if (palette_lookup > 0.5) {
+        color = palette_texel(texture_coordinate);
+        if (show_outline) {
+            float outline = 0.0;
+            outline += palette_texel(texture_coordinate + vec2(-pixel_size.x, 0.0)).a;
+            outline += palette_texel(texture_coordinate + vec2(0.0, pixel_size.y)).a;
+            outline += palette_texel(texture_coordinate + vec2(pixel_size.x, 0.0)).a;
+            outline += palette_texel(texture_coordinate + vec2(0.0, -pixel_size.y)).a;
+            outline += palette_texel(texture_coordinate + vec2(-pixel_size.x, -pixel_size.y)).a;
+            outline += palette_texel(texture_coordinate + vec2(pixel_size.x, -pixel_size.y)).a;
+            outline += palette_texel(texture_coordinate + vec2(-pixel_size.x, pixel_size.y)).a;
+            outline += palette_texel(texture_coordinate + vec2(pixel_size.x, pixel_size.y)).a;
+            color = mix(color, vec4(1.0), min(outline, 1.0) - color.a);
+        }
+        return;
+    }
+
     // sample each pixel that is a single pixel outside the current texture coordinate
     float outline = 0.0;
     outline += texture(sprite_texture, texture_coordinate + vec2(-pixel_size.x, 0.0)).a;
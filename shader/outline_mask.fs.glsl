@@ -0,0 +1,28 @@
+#version 410 core
+
+in vec2 texture_coordinate;
+flat in float palette_lookup;
+out vec4 color;
+
+uniform sampler2D sprite_texture;
+uniform sampler2D palette_texture;
+// Built by SpriteImage::build_outline_mask(), how much of the outline covers each texel
+uniform sampler2D outline_mask_texture;
+
+uniform bool show_outline;
+
+vec4 sprite_texel(vec2 coordinate) {
+    vec4 texel = texture(sprite_texture, coordinate);
+    if (palette_lookup > 0.5) {
+        texel = texelFetch(palette_texture, ivec2(int(texel.r * 255.0 + 0.5), 0), 0);
+    }
+    return texel;
+}
+
+// Same result as outline.fs.glsl, but the neighbor search was done once at load time so this is one extra tap instead of eight
+void main() {
+    color = sprite_texel(texture_coordinate);
+    if (show_outline) {
+        color = mix(color, vec4(1.0), texture(outline_mask_texture, texture_coordinate).r);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,11 @@
+#version 410 core
+
+layout (location = 0) in vec2 vertex_position;
+
+out vec2 texture_coordinate;
+
+// Covers the whole render target, passes read and write targets of the same size so texels map one to one
+void main() {
+    gl_Position = vec4((2.0 * vertex_position) - vec2(1.0, 1.0), 0.0, 1.0);
+    texture_coordinate = vertex_position;
+}
\ No newline at end of file
@@ -6,7 +6,13 @@ out vec4 color;
 uniform vec2 source_position;
 uniform vec2 source_size;
 uniform sampler2D sprite_texture;
+// Covers the same area as sprite_texture at a lower resolution, its linear filtering does the upsampling
+uniform sampler2D lightmap_texture;
+uniform bool lighting_enabled;
 
 void main() {
     color = texture(sprite_texture, texture_coordinate);
+    if (lighting_enabled) {
+        color.rgb *= texture(lightmap_texture, texture_coordinate).rgb;
+    }
 }
\ No newline at end of file
@@ -2,7 +2,13 @@
 
 layout (location = 0) in vec2 vertex_position;
 
-uniform vec2 screen_size;
+layout (std140) uniform Frame {
+    vec2 screen_size;
+    vec2 view_offset;
+    float view_zoom;
+    float time;
+};
+
 uniform vec2 dest_position;
 uniform vec2 dest_size;
 uniform vec2 source_position;
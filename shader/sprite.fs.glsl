@@ -0,0 +1,20 @@
+#version 410 core
+
+in vec2 texture_coordinate;
+flat in float palette_lookup;
+out vec4 color;
+
+uniform sampler2D sprite_texture;
+uniform sampler2D palette_texture;
+
+vec4 sprite_texel(vec2 coordinate) {
+    vec4 texel = texture(sprite_texture, coordinate);
+    if (palette_lookup > 0.5) {
+        texel = texelFetch(palette_texture, ivec2(int(texel.r * 255.0 + 0.5), 0), 0);
+    }
+    return texel;
+}
+
+void main() {
+    color = sprite_texel(texture_coordinate);
+}
\ No newline at end of file
@@ -1,31 +1,36 @@
 #version 410 core
 
 layout (location = 0) in vec2 vertex_position;
+// Per instance attributes, see Engine::SpriteInstance
+layout (location = 1) in vec2 dest_position;
+layout (location = 2) in vec2 source_position;
+layout (location = 3) in vec2 frame_size;
+layout (location = 4) in vec2 flip;
+layout (location = 5) in vec4 tint;
+layout (location = 6) in float palette;
+
+layout (std140) uniform Frame {
+    vec2 screen_size;
+    vec2 view_offset;
+    float view_zoom;
+    float time;
+};
 
-uniform vec2 screen_size;
-uniform vec2 dest_position;
-uniform vec2 dest_size;
-uniform vec2 source_position;
-uniform vec2 source_size;
-uniform bool flip_h;
-uniform bool flip_v;
 uniform sampler2D sprite_texture;
 
 out vec2 texture_coordinate;
+// 1 when sprite_texture holds indices into palette_texture
+flat out float palette_lookup;
 
 void main() {
-    vec2 position = dest_position + vec2(vertex_position.x * dest_size.x, vertex_position.y * dest_size.y);
+    vec2 position = dest_position + vec2(vertex_position.x * frame_size.x, vertex_position.y * frame_size.y);
+    position = (position - view_offset) * view_zoom;
     vec2 screen_space_position = (2.0 * vec2(position.x / screen_size.x, position.y / screen_size.y)) - vec2(1.0, 1.0);
     gl_Position = vec4(screen_space_position.x, screen_space_position.y, 0.0, 1.0);
 
     vec2 texture_size = vec2(textureSize(sprite_texture, 0));
-    texture_coordinate = vertex_position;
-    if (flip_h) {
-        texture_coordinate.x = 1.0 - texture_coordinate.x;
-    }
-    if (flip_v) {
-        texture_coordinate.y = 1.0 - texture_coordinate.y;
-    }
-    texture_coordinate = source_position + vec2(texture_coordinate.x * source_size.x, texture_coordinate.y * source_size.y);
+    texture_coordinate = mix(vertex_position, vec2(1.0) - vertex_position, flip);
+    texture_coordinate = source_position + vec2(texture_coordinate.x * frame_size.x, texture_coordinate.y * frame_size.y);
     texture_coordinate = vec2(texture_coordinate.x / texture_size.x, texture_coordinate.y / texture_size.y);
+    palette_lookup = palette;
 }
\ No newline at end of file
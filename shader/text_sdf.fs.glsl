@@ -0,0 +1,14 @@
+#version 410 core
+
+in vec2 texture_coordinate;
+in vec3 text_color;
+out vec4 color;
+
+uniform sampler2D sprite_texture;
+
+void main() {
+    // The glyph edge is at 0.5. Blending over about one screen pixel keeps it sharp at any scale without aliasing
+    float distance = texture(sprite_texture, texture_coordinate).r;
+    float smoothing = max(fwidth(distance) * 0.5, 0.001);
+    color = vec4(text_color, smoothstep(0.5 - smoothing, 0.5 + smoothing, distance));
+}
\ No newline at end of file
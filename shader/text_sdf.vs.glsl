@@ -0,0 +1,34 @@
+#version 410 core
+
+layout (location = 0) in vec2 vertex_position;
+// Per instance attributes, see Engine::SpriteInstance
+layout (location = 1) in vec2 dest_position;
+layout (location = 2) in vec2 source_position;
+layout (location = 3) in vec2 frame_size;
+layout (location = 5) in vec4 tint;
+
+layout (std140) uniform Frame {
+    vec2 screen_size;
+    vec2 view_offset;
+    float view_zoom;
+    float time;
+};
+
+uniform sampler2D sprite_texture;
+// Drawn size over the size the font's distance fields are stored at
+uniform float text_scale;
+
+out vec2 texture_coordinate;
+out vec3 text_color;
+
+void main() {
+    vec2 position = dest_position + (vec2(vertex_position.x * frame_size.x, vertex_position.y * frame_size.y) * text_scale);
+    position = (position - view_offset) * view_zoom;
+    vec2 screen_space_position = (2.0 * vec2(position.x / screen_size.x, position.y / screen_size.y)) - vec2(1.0, 1.0);
+    gl_Position = vec4(screen_space_position.x, screen_space_position.y, 0.0, 1.0);
+
+    vec2 texture_size = vec2(textureSize(sprite_texture, 0));
+    texture_coordinate = source_position + vec2(vertex_position.x * frame_size.x, vertex_position.y * frame_size.y);
+    texture_coordinate = vec2(texture_coordinate.x / texture_size.x, texture_coordinate.y / texture_size.y);
+    text_color = tint.rgb;
+}
\ No newline at end of file
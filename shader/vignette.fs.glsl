@@ -0,0 +1,14 @@
+#version 410 core
+
+in vec2 texture_coordinate;
+out vec4 color;
+
+uniform sampler2D source_texture;
+uniform float vignette_strength;
+
+void main() {
+    color = texture(source_texture, texture_coordinate);
+    // Zero inside the middle of the screen, rising to one in the corners
+    float distance_from_center = length(texture_coordinate - vec2(0.5, 0.5)) * 1.41421356;
+    color.rgb *= 1.0 - (vignette_strength * smoothstep(0.5, 1.0, distance_from_center));
+}
\ No newline at end of file
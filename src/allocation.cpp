@@ -0,0 +1,171 @@
+#include "allocation.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// glibc lets the program replace malloc and forward to its internal allocator, so allocations made by SDL and the GL driver can be seen too
+#if defined(SIREN_TRACK_ALLOCATIONS) && defined(__GLIBC__)
+    #define SIREN_HOOK_MALLOC
+#endif
+
+static std::atomic<unsigned long> allocation_count(0);
+static std::atomic<unsigned long> allocation_bytes(0);
+
+#ifdef SIREN_TRACK_ALLOCATIONS
+static const unsigned int MAX_ALLOCATION_SCOPES = 64;
+
+struct ScopeCounter {
+    std::atomic<const char*> name;
+    std::atomic<unsigned long> allocations;
+    std::atomic<unsigned long> bytes;
+};
+
+// Scope 0 collects allocations made outside of any scope. Everything here is constant initialized, so it is usable from malloc before main
+static ScopeCounter scope_counters[MAX_ALLOCATION_SCOPES];
+static thread_local unsigned int current_scope = 0;
+
+static unsigned int find_scope(const char* name) {
+    for (unsigned int i = 1; i < MAX_ALLOCATION_SCOPES; i++) {
+        const char* scope_name = scope_counters[i].name.load(std::memory_order_acquire);
+        if (scope_name == nullptr) {
+            if (scope_counters[i].name.compare_exchange_strong(scope_name, name, std::memory_order_acq_rel)) {
+                return i;
+            }
+        }
+        if (scope_name == name) {
+            return i;
+        }
+    }
+
+    // Out of scope slots, count it as unscoped
+    return 0;
+}
+
+siren::AllocationScope::AllocationScope(const char* name) {
+    previous_scope = current_scope;
+    current_scope = find_scope(name);
+}
+
+siren::AllocationScope::~AllocationScope() {
+    current_scope = previous_scope;
+}
+#endif
+
+static inline void record_allocation(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+#ifdef SIREN_TRACK_ALLOCATIONS
+    ScopeCounter& scope = scope_counters[current_scope];
+    scope.allocations.fetch_add(1, std::memory_order_relaxed);
+    scope.bytes.fetch_add(size, std::memory_order_relaxed);
+#endif
+}
+
+unsigned long siren::heap_allocation_count() {
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+unsigned long siren::heap_allocation_bytes() {
+    return allocation_bytes.load(std::memory_order_relaxed);
+}
+
+unsigned int siren::collect_allocation_scope_stats(AllocationScopeStats* stats, unsigned int max_stats) {
+    unsigned int count = 0;
+#ifdef SIREN_TRACK_ALLOCATIONS
+    for (unsigned int i = 0; i < MAX_ALLOCATION_SCOPES && count < max_stats; i++) {
+        const char* name = i == 0 ? "(no scope)" : scope_counters[i].name.load(std::memory_order_acquire);
+        if (name == nullptr) {
+            break;
+        }
+
+        unsigned long allocations = scope_counters[i].allocations.exchange(0, std::memory_order_relaxed);
+        unsigned long bytes = scope_counters[i].bytes.exchange(0, std::memory_order_relaxed);
+        if (allocations != 0) {
+            stats[count] = (AllocationScopeStats) {
+                .name = name,
+                .allocations = allocations,
+                .bytes = bytes
+            };
+            count++;
+        }
+    }
+#endif
+
+    return count;
+}
+
+#ifdef SIREN_HOOK_MALLOC
+/* malloc family replacements */
+
+extern "C" {
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* pointer, size_t size);
+    void __libc_free(void* pointer);
+
+    void* malloc(size_t size) {
+        record_allocation(size);
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size) {
+        record_allocation(count * size);
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* pointer, size_t size) {
+        record_allocation(size);
+        return __libc_realloc(pointer, size);
+    }
+
+    void free(void* pointer) {
+        __libc_free(pointer);
+    }
+}
+#endif
+
+/* Global allocation operators, replaced so that per frame heap traffic can be counted */
+
+void* operator new(std::size_t size) {
+#ifndef SIREN_HOOK_MALLOC
+    record_allocation(size);
+#endif
+    void* pointer = malloc(size == 0 ? 1 : size);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    return pointer;
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+#ifndef SIREN_HOOK_MALLOC
+    record_allocation(size);
+#endif
+    return malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& nothrow) noexcept {
+    return operator new(size, nothrow);
+}
+
+void operator delete(void* pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    free(pointer);
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+
+namespace siren {
+    // Heap allocations made since startup, from any thread. Counts operator new calls, or every malloc family call when allocation tracking hooks malloc
+    unsigned long heap_allocation_count();
+    unsigned long heap_allocation_bytes();
+
+    struct AllocationScopeStats {
+        const char* name;
+        unsigned long allocations;
+        unsigned long bytes;
+    };
+
+#ifdef SIREN_TRACK_ALLOCATIONS
+    // Attributes heap allocations made on this thread to name until the scope ends. name must be a string literal
+    class AllocationScope {
+    public:
+        AllocationScope(const char* name);
+        ~AllocationScope();
+
+    private:
+        unsigned int previous_scope;
+    };
+
+    #define SIREN_ALLOCATION_SCOPE(name) siren::AllocationScope siren_allocation_scope(name)
+#else
+    #define SIREN_ALLOCATION_SCOPE(name)
+#endif
+
+    // Writes the allocations attributed to each scope since the previous call and resets the per scope counters
+    // Returns the number of scopes written, which is always 0 unless built with SIREN_TRACK_ALLOCATIONS
+    unsigned int collect_allocation_scope_stats(AllocationScopeStats* stats, unsigned int max_stats);
+}
\ No newline at end of file
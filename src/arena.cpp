@@ -0,0 +1,108 @@
+#include "arena.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+
+using namespace siren;
+
+Arena::Arena() {
+    memory = nullptr;
+    memory_size = 0;
+    offset.store(0);
+    overflow_size = 0;
+}
+
+Arena::~Arena() {
+    reset();
+    free(memory);
+}
+
+bool Arena::init(size_t capacity) {
+    free(memory);
+    memory = (unsigned char*)malloc(capacity);
+    if (memory == nullptr) {
+        printf("Error allocating %zu byte arena\n", capacity);
+        memory_size = 0;
+        return false;
+    }
+    memory_size = capacity;
+    offset.store(0);
+
+    return true;
+}
+
+void* Arena::allocate(size_t size, size_t alignment) {
+    size_t current = offset.load(std::memory_order_relaxed);
+    size_t aligned;
+    do {
+        aligned = (current + alignment - 1) & ~(alignment - 1);
+        if (aligned + size > memory_size) {
+            // Out of room, hand out a heap block that lives until the next reset
+            std::lock_guard<std::mutex> lock(overflow_mutex);
+            void* block = malloc(size);
+            overflow_blocks.push_back(block);
+            overflow_size += size + alignment;
+            return block;
+        }
+    } while (!offset.compare_exchange_weak(current, aligned + size, std::memory_order_relaxed));
+
+    return memory + aligned;
+}
+
+void Arena::reset() {
+    if (!overflow_blocks.empty()) {
+        for (void* block : overflow_blocks) {
+            free(block);
+        }
+        overflow_blocks.clear();
+
+        // Grow so that next time the same workload fits
+        size_t capacity = memory_size;
+        while (capacity < memory_size + overflow_size) {
+            capacity = capacity == 0 ? 4096 : capacity * 2;
+        }
+        overflow_size = 0;
+        init(capacity);
+    }
+
+    offset.store(0, std::memory_order_relaxed);
+}
+
+const char* Arena::format(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    va_list args_copy;
+    va_copy(args_copy, args);
+    int length = vsnprintf(nullptr, 0, fmt, args_copy);
+    va_end(args_copy);
+
+    if (length < 0) {
+        va_end(args);
+        return "";
+    }
+
+    char* string = (char*)allocate(length + 1, 1);
+    vsnprintf(string, length + 1, fmt, args);
+    va_end(args);
+
+    return string;
+}
+
+const char* Arena::copy_string(const char* string) {
+    size_t length = strlen(string);
+    char* copy = (char*)allocate(length + 1, 1);
+    memcpy(copy, string, length + 1);
+
+    return copy;
+}
+
+size_t Arena::used() const {
+    size_t used = offset.load(std::memory_order_relaxed);
+    return used < memory_size ? used : memory_size;
+}
+
+size_t Arena::capacity() const {
+    return memory_size;
+}
\ No newline at end of file
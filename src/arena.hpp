@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+
+namespace siren {
+    // Bump allocator for transient data. Allocation is lock free and safe from any thread, reset() frees everything at once and must not race allocation
+    // If an arena runs out of room it falls back to heap blocks until the next reset(), which then grows the arena so the overflow doesn't happen again
+    class Arena {
+    public:
+        Arena();
+        ~Arena();
+        Arena(const Arena&) = delete;
+        void operator=(const Arena&) = delete;
+
+        bool init(size_t capacity);
+        void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+        void reset();
+
+        // Returns a printf-formatted string allocated in the arena
+        const char* format(const char* fmt, ...);
+        const char* copy_string(const char* string);
+
+        size_t used() const;
+        size_t capacity() const;
+
+    private:
+        unsigned char* memory;
+        size_t memory_size;
+        std::atomic<size_t> offset;
+
+        std::mutex overflow_mutex;
+        std::vector<void*> overflow_blocks;
+        size_t overflow_size;
+    };
+
+    // Lets standard containers allocate from an arena. Memory is only given back when the arena resets
+    template<typename T>
+    struct ArenaAllocator {
+        typedef T value_type;
+
+        Arena* arena;
+
+        ArenaAllocator(Arena* arena) {
+            this->arena = arena;
+        }
+        template<typename U>
+        ArenaAllocator(const ArenaAllocator<U>& other) {
+            arena = other.arena;
+        }
+        T* allocate(size_t count) {
+            return (T*)arena->allocate(count * sizeof(T), alignof(T));
+        }
+        void deallocate(T* pointer, size_t count) {}
+        template<typename U>
+        bool operator==(const ArenaAllocator<U>& other) const {
+            return arena == other.arena;
+        }
+        template<typename U>
+        bool operator!=(const ArenaAllocator<U>& other) const {
+            return arena != other.arena;
+        }
+    };
+
+    template<typename T>
+    using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+}
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "camera.hpp"
+
+#include "engine.hpp"
+
+#include <cmath>
+
+using namespace siren;
+
+Camera::Camera() {
+    position = vec2(0.0f, 0.0f);
+    target = position;
+    zoom = MIN_ZOOM;
+    smoothing = 0.2f;
+    has_bounds = false;
+}
+
+void Camera::update(float delta) {
+    // Frame rate independent exponential ease towards the target
+    float t = 1.0f - powf(1.0f - smoothing, delta * 60.0f);
+    position = position + ((target - position) * t);
+
+    // Settle once the remaining distance is under a screen pixel, so a resting camera doesn't keep moving by fractions
+    vec2 remaining = target - position;
+    if (fabsf(remaining.x) * zoom < 0.5f && fabsf(remaining.y) * zoom < 0.5f) {
+        position = target;
+    }
+}
+
+void Camera::pan(vec2 screen_distance) {
+    target = target + (screen_distance * (1.0f / (float)zoom));
+    clamp_target();
+}
+
+void Camera::zoom_at(int zoom_change, vec2 screen_position) {
+    int new_zoom = (int)zoom + zoom_change;
+    if (new_zoom < (int)MIN_ZOOM) {
+        new_zoom = MIN_ZOOM;
+    } else if (new_zoom > (int)MAX_ZOOM) {
+        new_zoom = MAX_ZOOM;
+    }
+    if ((unsigned int)new_zoom == zoom) {
+        return;
+    }
+
+    // Zoom snaps so the anchored point doesn't swim while the position eases
+    vec2 anchor = screen_to_world(screen_position);
+    zoom = (unsigned int)new_zoom;
+    target = anchor - (screen_position * (1.0f / (float)zoom));
+    clamp_target();
+    snap_to_target();
+}
+
+void Camera::snap_to_target() {
+    position = target;
+}
+
+void Camera::set_bounds(vec2 bounds_min, vec2 bounds_max) {
+    has_bounds = true;
+    this->bounds_min = bounds_min;
+    this->bounds_max = bounds_max;
+    clamp_target();
+}
+
+vec2 Camera::view_size() const {
+    const Engine& engine = Engine::instance();
+    return vec2((float)engine.screen_width / (float)zoom, (float)engine.screen_height / (float)zoom);
+}
+
+vec2 Camera::screen_to_world(vec2 screen_position) const {
+    return view_offset() + (screen_position * (1.0f / (float)zoom));
+}
+
+vec2 Camera::world_to_screen(vec2 world_position) const {
+    return (world_position - view_offset()) * (float)zoom;
+}
+
+vec2 Camera::view_offset() const {
+    return vec2(floorf(position.x * zoom) / (float)zoom, floorf(position.y * zoom) / (float)zoom);
+}
+
+void Camera::clamp_target() {
+    if (!has_bounds) {
+        return;
+    }
+
+    vec2 size = view_size();
+    float* target_axis[2] = { &target.x, &target.y };
+    float min_axis[2] = { bounds_min.x, bounds_min.y };
+    float max_axis[2] = { bounds_max.x, bounds_max.y };
+    float size_axis[2] = { size.x, size.y };
+    for (unsigned int i = 0; i < 2; i++) {
+        if (max_axis[i] - min_axis[i] <= size_axis[i]) {
+            *target_axis[i] = ((min_axis[i] + max_axis[i]) - size_axis[i]) * 0.5f;
+        } else if (*target_axis[i] < min_axis[i]) {
+            *target_axis[i] = min_axis[i];
+        } else if (*target_axis[i] > max_axis[i] - size_axis[i]) {
+            *target_axis[i] = max_axis[i] - size_axis[i];
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "math.hpp"
+
+namespace siren {
+    // 2D camera over world space. Zoom is a whole number of screen pixels per world pixel so sprites stay pixel perfect
+    class Camera {
+    public:
+        static const unsigned int MIN_ZOOM = 1;
+        static const unsigned int MAX_ZOOM = 4;
+
+        // World position shown at the top left of the screen
+        vec2 position;
+        // Position the camera is easing towards
+        vec2 target;
+        unsigned int zoom;
+        // Fraction of the remaining distance to the target covered every 1/60 second, 1 snaps straight to it
+        float smoothing;
+
+        Camera();
+        void update(float delta);
+        // Moves the target by a distance in screen pixels, so panning speed doesn't change with zoom
+        void pan(vec2 screen_distance);
+        // Changes zoom while keeping the world point under the screen position in place
+        void zoom_at(int zoom_change, vec2 screen_position);
+        void snap_to_target();
+        // Keeps the target inside a world rectangle, the camera is centered on any axis where the rectangle is smaller than the view
+        void set_bounds(vec2 bounds_min, vec2 bounds_max);
+
+        vec2 view_size() const;
+        vec2 screen_to_world(vec2 screen_position) const;
+        vec2 world_to_screen(vec2 world_position) const;
+        // Position rounded to whole screen pixels, which is what gets rendered
+        vec2 view_offset() const;
+
+    private:
+        bool has_bounds;
+        vec2 bounds_min;
+        vec2 bounds_max;
+
+        void clamp_target();
+    };
+}
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "command_buffer.hpp"
+
+#include <cstring>
+
+using namespace siren;
+
+// Keeps every command header aligned so replay can read commands in place
+static const size_t COMMAND_ALIGNMENT = 8;
+
+void CommandBuffer::clear() {
+    data.clear();
+}
+
+bool CommandBuffer::empty() const {
+    return data.empty();
+}
+
+const uint8_t* CommandBuffer::begin() const {
+    return data.data();
+}
+
+const uint8_t* CommandBuffer::end() const {
+    return data.data() + data.size();
+}
+
+void* CommandBuffer::push(CommandType type, size_t size) {
+    size_t command_size = (sizeof(CommandHeader) + size + COMMAND_ALIGNMENT - 1) & ~(COMMAND_ALIGNMENT - 1);
+    size_t offset = data.size();
+    data.resize(offset + command_size);
+
+    CommandHeader* header = (CommandHeader*)&data[offset];
+    header->type = type;
+    header->size = (uint32_t)command_size;
+
+    return &data[offset + sizeof(CommandHeader)];
+}
+
+void CommandBuffer::use_shader(Shader shader) {
+    UseShaderCommand* command = (UseShaderCommand*)push(COMMAND_USE_SHADER, sizeof(UseShaderCommand));
+    command->shader = shader;
+}
+
+void CommandBuffer::use_default_shader() {
+    push(COMMAND_USE_DEFAULT_SHADER, 0);
+}
+
+void CommandBuffer::set_shader_uniform(const char* name, bool value) {
+    SetUniformCommand* command = (SetUniformCommand*)push(COMMAND_SET_UNIFORM_BOOL, sizeof(SetUniformCommand));
+    command->name = name;
+    command->bool_value = value;
+}
+
+void CommandBuffer::set_shader_uniform(const char* name, unsigned int value) {
+    SetUniformCommand* command = (SetUniformCommand*)push(COMMAND_SET_UNIFORM_UINT, sizeof(SetUniformCommand));
+    command->name = name;
+    command->uint_value = value;
+}
+
+void CommandBuffer::set_shader_uniform(const char* name, vec2 value) {
+    SetUniformCommand* command = (SetUniformCommand*)push(COMMAND_SET_UNIFORM_VEC2, sizeof(SetUniformCommand));
+    command->name = name;
+    command->vec2_value[0] = value.x;
+    command->vec2_value[1] = value.y;
+}
+
+void CommandBuffer::set_shader_uniform(const char* name, ivec2 value) {
+    SetUniformCommand* command = (SetUniformCommand*)push(COMMAND_SET_UNIFORM_IVEC2, sizeof(SetUniformCommand));
+    command->name = name;
+    command->ivec2_value[0] = value.x;
+    command->ivec2_value[1] = value.y;
+}
+
+void CommandBuffer::set_shader_uniform(const char* name, Color value) {
+    SetUniformCommand* command = (SetUniformCommand*)push(COMMAND_SET_UNIFORM_COLOR, sizeof(SetUniformCommand));
+    command->name = name;
+    command->color_value[0] = value.r;
+    command->color_value[1] = value.g;
+    command->color_value[2] = value.b;
+}
+
+void CommandBuffer::render_text(Font& font, const char* text, vec2 position, Color color, TextAlign align, unsigned int max_width, float size) {
+    uint32_t length = strlen(text);
+    DrawTextCommand* command = (DrawTextCommand*)push(COMMAND_DRAW_TEXT, sizeof(DrawTextCommand) + length + 1);
+    command->font = &font;
+    command->position[0] = position.x;
+    command->position[1] = position.y;
+    command->color[0] = color.r;
+    command->color[1] = color.g;
+    command->color[2] = color.b;
+    command->align = align;
+    command->max_width = max_width;
+    command->size = size;
+    command->length = length;
+    memcpy(command + 1, text, length + 1);
+}
+
+void CommandBuffer::render_sprite(const Sprite& sprite, vec2 position, unsigned int hframe, unsigned int vframe, bool flip_h, bool flip_v) {
+    DrawSpriteCommand* command = (DrawSpriteCommand*)push(COMMAND_DRAW_SPRITE, sizeof(DrawSpriteCommand));
+    command->sprite = &sprite;
+    command->position[0] = position.x;
+    command->position[1] = position.y;
+    command->hframe = hframe;
+    command->vframe = vframe;
+    command->flip_h = flip_h;
+    command->flip_v = flip_v;
+}
\ No newline at end of file
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "math.hpp"
+#include "color.hpp"
+#include "font.hpp"
+#include "text_layout.hpp"
+#include "sprite.hpp"
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <vector>
+
+namespace siren {
+    typedef GLuint Shader;
+
+    // A list of render commands that can be recorded on any thread and later replayed on the GL thread with Engine::submit()
+    // Commands are packed back to back into one buffer which keeps its capacity across clear(), so recording doesn't allocate once warmed up
+    class CommandBuffer {
+    public:
+        enum CommandType : uint8_t {
+            COMMAND_USE_SHADER,
+            COMMAND_USE_DEFAULT_SHADER,
+            COMMAND_SET_UNIFORM_BOOL,
+            COMMAND_SET_UNIFORM_UINT,
+            COMMAND_SET_UNIFORM_VEC2,
+            COMMAND_SET_UNIFORM_IVEC2,
+            COMMAND_SET_UNIFORM_COLOR,
+            COMMAND_DRAW_SPRITE,
+            COMMAND_DRAW_TEXT
+        };
+
+        struct CommandHeader {
+            CommandType type;
+            uint32_t size;
+        };
+        struct UseShaderCommand {
+            Shader shader;
+        };
+        // Uniform names are stored as pointers, so they must outlive the buffer (string literals are fine)
+        struct SetUniformCommand {
+            const char* name;
+            union {
+                bool bool_value;
+                unsigned int uint_value;
+                float vec2_value[2];
+                int ivec2_value[2];
+                float color_value[3];
+            };
+        };
+        struct DrawSpriteCommand {
+            const Sprite* sprite;
+            float position[2];
+            unsigned int hframe;
+            unsigned int vframe;
+            bool flip_h;
+            bool flip_v;
+        };
+        // Followed in the buffer by the null terminated text
+        struct DrawTextCommand {
+            Font* font;
+            float position[2];
+            float color[3];
+            TextAlign align;
+            unsigned int max_width;
+            float size;
+            uint32_t length;
+        };
+
+        void clear();
+        bool empty() const;
+
+        void use_shader(Shader shader);
+        void use_default_shader();
+        void set_shader_uniform(const char* name, bool value);
+        void set_shader_uniform(const char* name, unsigned int value);
+        void set_shader_uniform(const char* name, vec2 value);
+        void set_shader_uniform(const char* name, ivec2 value);
+        void set_shader_uniform(const char* name, Color value);
+
+        void render_text(Font& font, const char* text, vec2 position, Color color, TextAlign align = TEXT_ALIGN_LEFT, unsigned int max_width = 0, float size = 0.0f);
+        void render_sprite(const Sprite& sprite, vec2 position, unsigned int hframe = 0, unsigned int vframe = 0, bool flip_h = false, bool flip_v = false);
+
+        const uint8_t* begin() const;
+        const uint8_t* end() const;
+
+    private:
+        std::vector<uint8_t> data;
+
+        void* push(CommandType type, size_t size);
+    };
+}
\ No newline at end of file
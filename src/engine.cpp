@@ -1,5 +1,7 @@
 #include "engine.hpp"
 
+#include "allocation.hpp"
+
 #include <glad/glad.h>
 #include <SDL2/SDL_image.h>
 #include <SDL2/SDL_ttf.h>
@@ -7,10 +9,13 @@
 #include <string>
 #include <fstream>
 #include <cmath>
+#include <algorithm>
+#include <cstddef>
+#include <utility>
 
 using namespace siren;
 
-bool Engine::init(const char* title, unsigned int screen_width, unsigned int screen_height) {
+bool Engine::init(const char* title, unsigned int screen_width, unsigned int screen_height, bool hidden) {
     /* Setup SDL  */
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         printf("Error initializing SDL: %s\n", SDL_GetError());
@@ -39,11 +44,13 @@ bool Engine::init(const char* title, unsigned int screen_width, unsigned int scr
     this->screen_height = screen_height;
     window_width = screen_width;
     window_height = screen_height;
-    window = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, screen_width, screen_height, SDL_WINDOW_OPENGL);
+    window = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, screen_width, screen_height, SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | (hidden ? SDL_WINDOW_HIDDEN : 0));
     if (window == nullptr) {
         printf("Error creating window: %s\n", SDL_GetError());
         return false;
     }
+    // Below the screen size the screen couldn't be shown at a whole number scale
+    SDL_SetWindowMinimumSize(window, screen_width, screen_height);
 
     // Create GL context
     context = SDL_GL_CreateContext(window);
@@ -59,6 +66,17 @@ bool Engine::init(const char* title, unsigned int screen_width, unsigned int scr
         return false;
     }
 
+    /* Setup shader cache */
+
+    shader_stats = (ShaderStats) {
+        .programs = 0,
+        .cache_hits = 0,
+        .milliseconds = 0.0
+    };
+    char* shader_cache_path = SDL_GetPrefPath("siren", "shader_cache");
+    shader_cache.init(shader_cache_path);
+    SDL_free(shader_cache_path);
+
     /* Setup Quad VAO */
 
     float quad_vertices[] = {
@@ -70,10 +88,8 @@ bool Engine::init(const char* title, unsigned int screen_width, unsigned int scr
         1.0f, 0.0f,
         1.0f, 1.0f
     };
-    GLuint quad_vbo;
-
-    glGenVertexArrays(1, &quad_vao);
-    glGenBuffers(1, &quad_vbo);
+    quad_vao.create("Quad vertex array");
+    quad_vbo.create("Quad vertex buffer");
     glBindVertexArray(quad_vao);
     glBindBuffer(GL_ARRAY_BUFFER, quad_vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(quad_vertices), &quad_vertices, GL_STATIC_DRAW);
@@ -83,57 +99,188 @@ bool Engine::init(const char* title, unsigned int screen_width, unsigned int scr
 
     glBindVertexArray(0);
 
-    /* Setup screen framebuffer */
-    
-    glGenFramebuffers(1, &screen_framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, screen_framebuffer);
+    /* Setup sprite batch VAO, the quad plus one SpriteInstance per instance */
 
-    glActiveTexture(GL_TEXTURE0);
-    glGenTextures(1, &screen_texture);
-    glBindTexture(GL_TEXTURE_2D, screen_texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, screen_width, screen_height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, screen_texture, 0);
+    sprite_vao.create("Sprite vertex array");
+    instance_vbo.create("Sprite instance buffer");
+    glBindVertexArray(sprite_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, quad_vbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(sprite_batch), nullptr, GL_STREAM_DRAW);
+    setup_sprite_instance_attributes();
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    sprite_batch_count = 0;
+    sprite_batch_texture = 0;
+    sprite_batch_palette = 0;
+    sprite_batch_outline_mask = 0;
+    draw_call_count = 0;
+    instance_vbo.set_bytes(sizeof(sprite_batch));
+    vram_track(&instance_vbo, "Sprite instance buffer", sizeof(sprite_batch));
+
+    /* Setup particle VAO, the same layout with a buffer that's sized on first use */
+
+    particle_vao.create("Particle vertex array");
+    particle_vbo.create("Particle instance buffer");
+    glBindVertexArray(particle_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, quad_vbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+    glBindBuffer(GL_ARRAY_BUFFER, particle_vbo);
+    setup_sprite_instance_attributes();
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    particle_vbo_capacity = 0;
+
+    /* Setup lighting */
+
+    // Quadratic falloff from full brightness at the center to nothing at the edge
+    uint8_t falloff[LIGHT_TEXTURE_SIZE * LIGHT_TEXTURE_SIZE];
+    for (unsigned int y = 0; y < LIGHT_TEXTURE_SIZE; y++) {
+        for (unsigned int x = 0; x < LIGHT_TEXTURE_SIZE; x++) {
+            float offset_x = (((float)x + 0.5f) / (float)LIGHT_TEXTURE_SIZE * 2.0f) - 1.0f;
+            float offset_y = (((float)y + 0.5f) / (float)LIGHT_TEXTURE_SIZE * 2.0f) - 1.0f;
+            float brightness = std::max(1.0f - sqrtf((offset_x * offset_x) + (offset_y * offset_y)), 0.0f);
+            falloff[x + (y * LIGHT_TEXTURE_SIZE)] = (uint8_t)((brightness * brightness * 255.0f) + 0.5f);
+        }
+    }
+    light_texture = Sprite::create_texture("Light falloff", GL_R8, LIGHT_TEXTURE_SIZE, LIGHT_TEXTURE_SIZE, GL_RED, falloff);
+    light_texture.set_bytes(LIGHT_TEXTURE_SIZE * LIGHT_TEXTURE_SIZE);
+    // Lights are stretched well past the texture's size, so it's filtered
+    glBindTexture(GL_TEXTURE_2D, light_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glBindTexture(GL_TEXTURE_2D, 0);
+    lighting_enabled = false;
+    ambient_light = COLOR_WHITE;
+    light_count = 0;
 
-    GLuint rbo;
-    glGenRenderbuffers(1, &rbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, screen_width, screen_height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    /* Setup render targets */
 
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        printf("Screen framebuffer not complete!\n");
+    if (!create_render_targets()) {
         return false;
     }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    update_window_layout();
+
+    retained_mode = false;
+    dirty_all = true;
+    dirty_rect_count = 0;
+    frame_dirty_all = true;
+    frame_dirty_rect_count = 0;
+    redrawn_pixel_count = 0;
+
+    post_process_passes.reserve(MAX_POST_PROCESS_PASSES);
+    post_process_frame = 0;
+
+    /* Setup frame uniform block */
+
+    // Each slot's offset has to be a multiple of the uniform buffer alignment
+    GLint uniform_alignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_alignment);
+    frame_slot_size = (((GLint)sizeof(FrameUniforms) + uniform_alignment - 1) / uniform_alignment) * uniform_alignment;
+
+    frame_ubo.create("Frame uniform buffer");
+    glBindBuffer(GL_UNIFORM_BUFFER, frame_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, frame_slot_size * VIEW_COUNT, nullptr, GL_DYNAMIC_DRAW);
+    frame_ubo.set_bytes(frame_slot_size * VIEW_COUNT);
+    for (unsigned int i = 0; i < VIEW_COUNT; i++) {
+        frame_uniforms[i] = (FrameUniforms) {
+            .screen_size = { (float)screen_width, (float)screen_height },
+            .view_offset = { 0.0f, 0.0f },
+            .view_zoom = 1.0f,
+            .time = 0.0f,
+            .padding = { 0.0f, 0.0f }
+        };
+        glBufferSubData(GL_UNIFORM_BUFFER, frame_slot_size * i, sizeof(FrameUniforms), &frame_uniforms[i]);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    use_view(VIEW_SCREEN);
 
     if (!load_shader(&screen_shader, "./shader/screen.vs.glsl", "./shader/screen.fs.glsl")) {
         return false;
     }
-    use_shader(screen_shader);
-    set_shader_uniform("screen_size", vec2((float)screen_width, (float)screen_height));
 
     if (!load_shader(&text_shader, "./shader/text.vs.glsl", "./shader/text.fs.glsl")) {
         return false;
     }
-    use_shader(text_shader);
-    set_shader_uniform("screen_size", vec2((float)screen_width, (float)screen_height));
 
-    if (!load_shader(&default_shader, "./shader/sprite.vs.glsl", "./shader/screen.fs.glsl")) {
+    if (!load_shader(&text_sdf_shader, "./shader/text_sdf.vs.glsl", "./shader/text_sdf.fs.glsl")) {
+        return false;
+    }
+    use_shader(text_sdf_shader);
+    set_shader_uniform("text_scale", 1.0f);
+    text_sdf_scale = 1.0f;
+
+    if (!load_shader(&default_shader, "./shader/sprite.vs.glsl", "./shader/sprite.fs.glsl")) {
         return false;
     }
     use_default_shader();
-    set_shader_uniform("screen_size", vec2((float)screen_width, (float)screen_height));
+    set_shader_uniform("sprite_texture", 0);
+    set_shader_uniform("palette_texture", 1);
+
+    if (!load_shader(&light_shader, "./shader/light.vs.glsl", "./shader/light.fs.glsl")) {
+        return false;
+    }
+    use_shader(light_shader);
+    set_shader_uniform("sprite_texture", 0);
+
+    // Leave one core for the main thread, which also runs jobs while it waits on them
+    int cpu_count = SDL_GetCPUCount();
+    if (!jobs.init(cpu_count > 1 ? cpu_count - 1 : 0)) {
+        return false;
+    }
+    if (!texture_streamer.init(&jobs)) {
+        return false;
+    }
+    texture_upload_byte_count = 0;
+
+    for (unsigned int i = 0; i < 2; i++) {
+        if (!frame_arenas[i].init(FRAME_ARENA_SIZE)) {
+            return false;
+        }
+    }
+    frame_index = 0;
+    last_heap_allocation_count = heap_allocation_count();
+    last_heap_allocation_bytes = heap_allocation_bytes();
+    collect_allocation_scope_stats(frame_stats.allocation_scopes, FrameStats::MAX_ALLOCATION_SCOPES);
+
+    frame_limiter = true;
+    fixed_timestep = 0.0f;
+    frame_events.reserve(MAX_FRAME_EVENTS);
 
     fps = 0;
+    time = 0.0f;
     running = true;
     return true;
 }
 
 Engine::~Engine() {
+    replay_recorder.close();
+    replay_player.close();
+    texture_streamer.quit();
+    jobs.quit();
+
+    // Delete what the engine made while the context is still current. Anything else alive after this is reported as a leak
+    destroy_render_targets();
+    post_process_passes.clear();
+    programs.clear();
+    light_texture.reset();
+    frame_ubo.reset();
+    sprite_vao.reset();
+    instance_vbo.reset();
+    particle_vao.reset();
+    particle_vbo.reset();
+    quad_vao.reset();
+    quad_vbo.reset();
+    vram_untrack(&instance_vbo);
+    vram_untrack(&particle_vbo);
+    gpu_objects_release_context();
+    SDL_GL_DeleteContext(context);
     SDL_DestroyWindow(window);
 
     TTF_Quit();
@@ -146,15 +293,128 @@ void Engine::set_window_size(unsigned int window_width, unsigned int window_heig
     this->window_height = window_height;
     SDL_SetWindowSize(window, window_width, window_height);
     SDL_SetWindowPosition(window, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED);
+    update_window_layout();
+}
+
+void Engine::set_fullscreen(bool enabled) {
+    if (SDL_SetWindowFullscreen(window, enabled ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0) != 0) {
+        printf("Error changing fullscreen mode: %s\n", SDL_GetError());
+        return;
+    }
+
+    // The size changed event comes later, but the layout shouldn't wait for it
+    int width, height;
+    SDL_GetWindowSize(window, &width, &height);
+    window_width = width;
+    window_height = height;
+    update_window_layout();
+}
+
+bool Engine::is_fullscreen() const {
+    return (SDL_GetWindowFlags(window) & SDL_WINDOW_FULLSCREEN_DESKTOP) != 0;
+}
+
+bool Engine::set_screen_size(unsigned int screen_width, unsigned int screen_height) {
+    render_flush();
+    destroy_render_targets();
+
+    this->screen_width = screen_width;
+    this->screen_height = screen_height;
+    for (unsigned int i = 0; i < VIEW_COUNT; i++) {
+        frame_uniforms[i].screen_size[0] = (float)screen_width;
+        frame_uniforms[i].screen_size[1] = (float)screen_height;
+    }
+    SDL_SetWindowMinimumSize(window, screen_width, screen_height);
+    if (!create_render_targets()) {
+        return false;
+    }
+    update_window_layout();
+    invalidate_all();
+
+    return true;
+}
+
+void Engine::update_window_layout() {
+    // The largest whole number scale that fits the window, centered between black bars
+    unsigned int scale = std::max(std::min(window_width / screen_width, window_height / screen_height), 1u);
+    present_width = screen_width * scale;
+    present_height = screen_height * scale;
+    present_x = ((int)window_width - (int)present_width) / 2;
+    present_y = ((int)window_height - (int)present_height) / 2;
+    input.set_window_transform(vec2((float)present_x, (float)present_y), vec2((float)scale, (float)scale));
+}
+
+bool Engine::create_render_targets() {
+    screen_framebuffer.create("Screen framebuffer");
+    glBindFramebuffer(GL_FRAMEBUFFER, screen_framebuffer);
+
+    glActiveTexture(GL_TEXTURE0);
+    screen_texture.create("Screen texture");
+    glBindTexture(GL_TEXTURE_2D, screen_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, screen_width, screen_height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, screen_texture, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    screen_depth_stencil.create("Screen depth stencil");
+    glBindRenderbuffer(GL_RENDERBUFFER, screen_depth_stencil);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, screen_width, screen_height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, screen_depth_stencil);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        printf("Screen framebuffer not complete!\n");
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return false;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // Drivers store RGB8 with a padding byte, plus the depth stencil buffer
+    screen_texture.set_bytes(screen_width * screen_height * 4);
+    screen_depth_stencil.set_bytes(screen_width * screen_height * 4);
+    vram_track(&screen_framebuffer, "Screen framebuffer", screen_width * screen_height * (4 + 4));
+
+    for (const PostProcessPass& pass : post_process_passes) {
+        if (pass.enabled) {
+            create_post_process_targets();
+            break;
+        }
+    }
+    if (lighting_enabled) {
+        create_lightmap();
+    }
+
+    return true;
+}
+
+void Engine::destroy_render_targets() {
+    screen_framebuffer.reset();
+    screen_texture.reset();
+    screen_depth_stencil.reset();
+    vram_untrack(&screen_framebuffer);
+
+    if (post_process_framebuffers[0] != 0) {
+        for (unsigned int i = 0; i < 2; i++) {
+            post_process_framebuffers[i].reset();
+            post_process_textures[i].reset();
+        }
+        vram_untrack(post_process_framebuffers);
+    }
+
+    if (lightmap_framebuffer != 0) {
+        lightmap_framebuffer.reset();
+        lightmap_texture.reset();
+        vram_untrack(&lightmap_framebuffer);
+    }
 }
 
 void Engine::timekeep() {
     unsigned long current_time = SDL_GetTicks();
-    while (current_time - last_time < FRAME_TIME) {
+    while (frame_limiter && current_time - last_time < FRAME_TIME) {
         current_time = SDL_GetTicks();
     }
 
-    delta = (float)(current_time - last_time) / 1000.0f;
+    delta = fixed_timestep != 0.0f ? fixed_timestep : (float)(current_time - last_time) / 1000.0f;
     last_time = current_time;
 
     if (current_time - last_second >= 1000) {
@@ -164,20 +424,113 @@ void Engine::timekeep() {
     }
 
     frames++;
+
+    // Finish the stats for the frame that just ended and start the next one
+    unsigned long current_heap_allocation_count = heap_allocation_count();
+    unsigned long current_heap_allocation_bytes = heap_allocation_bytes();
+    frame_stats.heap_allocations = current_heap_allocation_count - last_heap_allocation_count;
+    frame_stats.heap_bytes = current_heap_allocation_bytes - last_heap_allocation_bytes;
+    frame_stats.frame_arena_bytes = frame_arena().used();
+    frame_stats.draw_calls = draw_call_count;
+    draw_call_count = 0;
+    frame_stats.texture_upload_bytes = texture_upload_byte_count;
+    texture_upload_byte_count = 0;
+    frame_stats.redrawn_pixels = redrawn_pixel_count;
+    redrawn_pixel_count = 0;
+    frame_stats.allocation_scope_count = collect_allocation_scope_stats(frame_stats.allocation_scopes, FrameStats::MAX_ALLOCATION_SCOPES);
+    last_heap_allocation_count = current_heap_allocation_count;
+    last_heap_allocation_bytes = current_heap_allocation_bytes;
+
+    frame_index++;
+    frame_arena().reset();
+}
+
+void Engine::set_frame_limiter(bool enabled) {
+    frame_limiter = enabled;
+    SDL_GL_SetSwapInterval(enabled ? 1 : 0);
+}
+
+void Engine::set_fixed_timestep(float timestep) {
+    fixed_timestep = timestep;
+}
+
+bool Engine::record_replay(const char* path) {
+    replay_start_time = SDL_GetTicks();
+    return replay_recorder.open(path, screen_width, screen_height);
+}
+
+bool Engine::play_replay(const char* path) {
+    if (!replay_player.open(path, screen_width, screen_height)) {
+        return false;
+    }
+    set_frame_limiter(false);
+
+    return true;
+}
+
+Arena& Engine::frame_arena() {
+    return frame_arenas[frame_index % 2];
+}
+
+void Engine::print_allocation_report() const {
+    printf("Frame allocations: %lu (%lu bytes), frame arena: %zu bytes\n", frame_stats.heap_allocations, frame_stats.heap_bytes, frame_stats.frame_arena_bytes);
+    for (unsigned int i = 0; i < frame_stats.allocation_scope_count; i++) {
+        const AllocationScopeStats& scope = frame_stats.allocation_scopes[i];
+        printf("    %-32s %8lu allocations %10lu bytes\n", scope.name, scope.allocations, scope.bytes);
+    }
 }
 
 void Engine::poll_events() {
+    SIREN_ALLOCATION_SCOPE("Engine::poll_events");
+
+    frame_events.clear();
+
     SDL_Event e;
+    InputEvent event;
     while (SDL_PollEvent(&e) != 0) {
-        if (e.type == SDL_QUIT) {
+        // Resizes aren't input, so they're handled the same during replays and never recorded
+        if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+            window_width = e.window.data1;
+            window_height = e.window.data2;
+            update_window_layout();
+            continue;
+        }
+
+        if (replay_player.is_open()) {
+            // Real input is ignored during a replay, except for closing the window
+            if (e.type == SDL_QUIT) {
+                running = false;
+            }
+        } else if (input_event_from_sdl(e, &event) && frame_events.size() < MAX_FRAME_EVENTS) {
+            frame_events.push_back(event);
+        }
+    }
+
+    if (replay_player.is_open() && !replay_player.read_frame(&delta, &frame_events)) {
+        replay_player.close();
+        running = false;
+    }
+    time += delta;
+
+    input.begin_frame();
+    for (const InputEvent& frame_event : frame_events) {
+        if (frame_event.type == InputEvent::QUIT) {
             running = false;
         }
+        input.handle_event(frame_event);
+    }
+    input.end_frame();
+
+    if (replay_recorder.is_open()) {
+        replay_recorder.write_frame(SDL_GetTicks() - replay_start_time, delta, frame_events);
     }
 }
 
 /* Shader functions */
 
 bool Engine::load_shader(Shader* id, const char* vertex_path, const char* fragment_path) {
+    SIREN_ALLOCATION_SCOPE("Engine::load_shader");
+
     GLuint shader[2];
     std::string source[2];
     std::ifstream file[2];
@@ -188,6 +541,8 @@ bool Engine::load_shader(Shader* id, const char* vertex_path, const char* fragme
     char info_log[512];
     std::string line;
 
+    Uint64 start_time = SDL_GetPerformanceCounter();
+
     for (int i = 0; i < 2; i++) {
         file[i].open(path[i]);
         if (!file[i].is_open()) {
@@ -200,41 +555,76 @@ bool Engine::load_shader(Shader* id, const char* vertex_path, const char* fragme
         }
 
         file[i].close();
+    }
+
+    // Try the program binary cache before compiling
+    uint64_t cache_key = shader_cache.key(source[0], source[1]);
+    // Owned by the handle until it's known to be good, so a failed load doesn't leave the program behind
+    ProgramHandle program;
+    program.create(fragment_path);
+    *id = program;
+    bool cache_hit = shader_cache.load(cache_key, *id);
+
+    if (!cache_hit) {
+        for (int i = 0; i < 2; i++) {
+            shader[i] = glCreateShader(type[i]);
+            const char* source_cstr = source[i].c_str();
+            glShaderSource(shader[i], 1, &source_cstr, nullptr);
+            glCompileShader(shader[i]);
+
+            glGetShaderiv(shader[i], GL_COMPILE_STATUS, &success);
+            if (!success) {
+                glGetShaderInfoLog(shader[i], 512, nullptr, info_log);
+                printf("Error: shader %s failed to compile: %s\n", path[i], info_log);
+                for (int j = 0; j <= i; j++) {
+                    glDeleteShader(shader[j]);
+                }
+                return false;
+            }
+        }
 
-        shader[i] = glCreateShader(type[i]);
-        const char* source_cstr = source[i].c_str();
-        glShaderSource(shader[i], 1, &source_cstr, nullptr);
-        glCompileShader(shader[i]);
+        glAttachShader(*id, shader[0]);
+        glAttachShader(*id, shader[1]);
+        glProgramParameteri(*id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(*id);
 
-        glGetShaderiv(shader[i], GL_COMPILE_STATUS, &success);
+        glGetProgramiv(*id, GL_LINK_STATUS, &success);
         if (!success) {
-            glGetShaderInfoLog(shader[i], 512, nullptr, info_log);
-            printf("Error: shader %s failed to compile: %s\n", path[i], info_log);
-            return false;
+            glGetProgramInfoLog(*id, 512, nullptr, info_log);
+            printf("Error linking shader program. Vertex: %s Fragment %s Error: %s\n", vertex_path, fragment_path, info_log);
+        } else {
+            shader_cache.save(cache_key, *id);
         }
-    }
 
-    *id = glCreateProgram();
-    glAttachShader(*id, shader[0]);
-    glAttachShader(*id, shader[1]);
-    glLinkProgram(*id);
+        glDetachShader(*id, shader[0]);
+        glDetachShader(*id, shader[1]);
+        glDeleteShader(shader[0]);
+        glDeleteShader(shader[1]);
+    }
 
-    glGetProgramiv(*id, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(*id, 512, nullptr, info_log);
-        printf("Error linking shader program. Vertex: %s Fragment %s Error: %s\n", vertex_path, fragment_path, info_log);
+    // Linking, or loading a binary, resets the program's uniform block bindings
+    GLuint frame_block = glGetUniformBlockIndex(*id, "Frame");
+    if (frame_block != GL_INVALID_INDEX) {
+        glUniformBlockBinding(*id, frame_block, FRAME_BLOCK_BINDING);
     }
 
-    glDeleteShader(shader[0]);
-    glDeleteShader(shader[1]);
+    programs.push_back(std::move(program));
+    shader_stats.programs++;
+    shader_stats.cache_hits += cache_hit ? 1 : 0;
+    shader_stats.milliseconds += (double)(SDL_GetPerformanceCounter() - start_time) * 1000.0 / (double)SDL_GetPerformanceFrequency();
 
     return true;
 }
 
+void Engine::print_shader_report() const {
+    printf("Shaders: %u programs in %.3f ms, %u from the cache and %u compiled%s\n", shader_stats.programs, shader_stats.milliseconds, shader_stats.cache_hits, shader_stats.programs - shader_stats.cache_hits, shader_cache.is_enabled() ? "" : ", cache disabled");
+}
+
 void Engine::use_shader(Shader shader) {
     if (current_shader == shader) {
         return;
     }
+    render_flush();
     current_shader = shader;
     glUseProgram(current_shader);
 }
@@ -244,85 +634,545 @@ void Engine::use_default_shader() {
 }
 
 void Engine::set_shader_uniform(const char* name, bool value) {
+    render_flush();
+    glUniform1i(glGetUniformLocation(current_shader, name), value);
+}
+
+void Engine::set_shader_uniform(const char* name, int value) {
+    render_flush();
     glUniform1i(glGetUniformLocation(current_shader, name), value);
 }
 
 void Engine::set_shader_uniform(const char* name, unsigned int value) {
+    render_flush();
     glUniform1ui(glGetUniformLocation(current_shader, name), value);
 }
 
+void Engine::set_shader_uniform(const char* name, float value) {
+    render_flush();
+    glUniform1f(glGetUniformLocation(current_shader, name), value);
+}
+
 void Engine::set_shader_uniform(const char* name, vec2 value) {
+    render_flush();
     glUniform2fv(glGetUniformLocation(current_shader, name), 1, value.value_ptr());
 }
 
 void Engine::set_shader_uniform(const char* name, ivec2 value) {
+    render_flush();
     glUniform2iv(glGetUniformLocation(current_shader, name), 1, value.value_ptr());
 }
 
 void Engine::set_shader_uniform(const char* name, Color value) {
+    render_flush();
     glUniform3fv(glGetUniformLocation(current_shader, name), 1, value.value_ptr());
 }
 
 /* Render functions */
 
+/* View functions */
+
+void Engine::set_camera(const Camera& camera) {
+    render_flush();
+
+    vec2 offset = camera.view_offset();
+    FrameUniforms& world_uniforms = frame_uniforms[VIEW_WORLD];
+    world_uniforms.view_offset[0] = offset.x;
+    world_uniforms.view_offset[1] = offset.y;
+    world_uniforms.view_zoom = (float)camera.zoom;
+    glBindBuffer(GL_UNIFORM_BUFFER, frame_ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, frame_slot_size * VIEW_WORLD, sizeof(FrameUniforms), &world_uniforms);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void Engine::use_view(View view) {
+    render_flush();
+    current_view = view;
+    glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, frame_ubo, frame_slot_size * view, sizeof(FrameUniforms));
+}
+
 void Engine::render_clear() {
+    SIREN_ALLOCATION_SCOPE("Engine::render_clear");
+
+    render_flush();
+
+    texture_upload_byte_count += texture_streamer.update();
+
+    // The whole frame block is uploaded once here, only the world slot changes again when the camera is set
+    glBindBuffer(GL_UNIFORM_BUFFER, frame_ubo);
+    for (unsigned int i = 0; i < VIEW_COUNT; i++) {
+        frame_uniforms[i].time = time;
+        glBufferSubData(GL_UNIFORM_BUFFER, frame_slot_size * i, sizeof(FrameUniforms), &frame_uniforms[i]);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
     glBindFramebuffer(GL_FRAMEBUFFER, screen_framebuffer);
     glViewport(0, 0, screen_width, screen_height);
     glEnable(GL_BLEND);
     glBlendFunc(GL_ONE, GL_ZERO);
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if (!retained_mode || dirty_all) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        frame_dirty_all = true;
+        frame_dirty_rect_count = 0;
+        redrawn_pixel_count += screen_width * screen_height;
+    } else {
+        frame_dirty_all = false;
+        frame_dirty_rect_count = dirty_rect_count;
+        // The stencil is reset across the whole screen before the scissor test is turned on
+        if (dirty_rect_count > 1) {
+            glClearStencil(0);
+            glClear(GL_STENCIL_BUFFER_BIT);
+            glClearStencil(1);
+        }
+        glEnable(GL_SCISSOR_TEST);
+        // Nothing changed, the draws are all skipped anyway
+        if (dirty_rect_count == 0) {
+            glScissor(0, 0, 0, 0);
+        }
+        for (unsigned int i = 0; i < dirty_rect_count; i++) {
+            const DirtyRect& rect = dirty_rects[i];
+            frame_dirty_rects[i] = rect;
+            // Screen y runs down from GL row 0, so the rect needs no flipping
+            glScissor(rect.min.x, rect.min.y, rect.max.x - rect.min.x, rect.max.y - rect.min.y);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | (dirty_rect_count > 1 ? GL_STENCIL_BUFFER_BIT : 0));
+            redrawn_pixel_count += (rect.max.x - rect.min.x) * (rect.max.y - rect.min.y);
+        }
+        if (dirty_rect_count > 1) {
+            glDisable(GL_SCISSOR_TEST);
+            glClearStencil(0);
+            glEnable(GL_STENCIL_TEST);
+            glStencilFunc(GL_EQUAL, 1, 0xFF);
+            glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+        }
+    }
+    dirty_all = false;
+    dirty_rect_count = 0;
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     use_default_shader();
+    use_view(VIEW_SCREEN);
 }
 
 void Engine::render_flip() {
+    SIREN_ALLOCATION_SCOPE("Engine::render_flip");
+
+    render_flush();
+
+    glDisable(GL_SCISSOR_TEST);
+    glDisable(GL_STENCIL_TEST);
+    if (lighting_enabled) {
+        render_lightmap();
+    }
+    light_count = 0;
+    glBlendFunc(GL_ONE, GL_ZERO);
+    GLuint present_texture = render_post_process();
+
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glViewport(0, 0, window_width, window_height);
-    glBlendFunc(GL_ONE, GL_ZERO);
-    glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
+    // GL's viewport origin is the bottom left of the window
+    glViewport(present_x, (int)window_height - present_y - (int)present_height, present_width, present_height);
 
     use_shader(screen_shader);
-    set_shader_uniform("sprite_texture", (unsigned int)0);
-    set_shader_uniform("source_position", vec2());
+    set_shader_uniform("sprite_texture", 0);
+    set_shader_uniform("source_position", vec2(0.0f, 0.0f));
     set_shader_uniform("source_size", vec2(screen_width, screen_height));
-    set_shader_uniform("dest_position", vec2());
+    set_shader_uniform("dest_position", vec2(0.0f, 0.0f));
     set_shader_uniform("dest_size", vec2(screen_width, screen_height));
+    set_shader_uniform("lightmap_texture", 1);
+    set_shader_uniform("lighting_enabled", lighting_enabled);
 
+    if (lighting_enabled) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, lightmap_texture);
+        glActiveTexture(GL_TEXTURE0);
+    }
     glBindVertexArray(quad_vao);
-    glBindTexture(GL_TEXTURE_2D, screen_texture);
+    glBindTexture(GL_TEXTURE_2D, present_texture);
     glDrawArrays(GL_TRIANGLES, 0, 6);
     glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    if (lighting_enabled) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    draw_call_count++;
 
     SDL_GL_SwapWindow(window);
 }
 
-void Engine::render_text(const Font& font, std::string text, vec2 position, Color color) {
-    use_shader(text_shader);
-    set_shader_uniform("sprite_texture", (unsigned int)0);
-    set_shader_uniform("text_color", color);
-    set_shader_uniform("source_size", vec2((float)font.glyph_width, (float)font.glyph_height));
-    set_shader_uniform("dest_size", vec2((float)font.glyph_width, (float)font.glyph_height));
+/* Lighting */
 
+void Engine::set_lighting_enabled(bool enabled) {
+    lighting_enabled = enabled;
+    if (enabled && lightmap_framebuffer == 0) {
+        create_lightmap();
+    }
+}
+
+void Engine::set_ambient_light(Color color) {
+    ambient_light = color;
+}
+
+void Engine::render_light(vec2 position, float radius, Color color) {
+    if (!lighting_enabled || light_count == MAX_LIGHTS) {
+        return;
+    }
+
+    lights[light_count] = (Light) {
+        .view = current_view,
+        .instance = (SpriteInstance) {
+            .dest_position = { position.x - radius, position.y - radius },
+            .source_position = { 0.0f, 0.0f },
+            .size = { radius * 2.0f, radius * 2.0f },
+            .flip = { 0, 0 },
+            .palette = 0,
+            .padding = 0,
+            .color = { (uint8_t)(color.r * 255.0f), (uint8_t)(color.g * 255.0f), (uint8_t)(color.b * 255.0f), 255 }
+        }
+    };
+    light_count++;
+}
+
+void Engine::create_lightmap() {
+    lightmap_width = std::max(screen_width / LIGHTMAP_DIVISOR, 1u);
+    lightmap_height = std::max(screen_height / LIGHTMAP_DIVISOR, 1u);
+
+    lightmap_framebuffer.create("Lightmap framebuffer");
+    lightmap_texture.create("Lightmap");
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, font.atlas);
-    glBindVertexArray(quad_vao);
+    glBindTexture(GL_TEXTURE_2D, lightmap_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, lightmap_width, lightmap_height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindFramebuffer(GL_FRAMEBUFFER, lightmap_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, lightmap_texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        printf("Lightmap framebuffer not complete!\n");
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    lightmap_texture.set_bytes(lightmap_width * lightmap_height * 4);
+    vram_track(&lightmap_framebuffer, "Lightmap", lightmap_width * lightmap_height * 4);
+}
 
-    vec2 render_position = position;
-    for (char c : text) {
-        int glyph_index = (int)c - Font::FIRST_CHAR;
-        set_shader_uniform("source_position", vec2((float)(font.glyph_width * glyph_index), 0));
-        set_shader_uniform("dest_position", render_position);
+void Engine::render_lightmap() {
+    glBindFramebuffer(GL_FRAMEBUFFER, lightmap_framebuffer);
+    glViewport(0, 0, lightmap_width, lightmap_height);
+    glClearColor(ambient_light.r, ambient_light.g, ambient_light.b, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
 
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+    // Lights add together, anything brighter than full is clipped
+    glBlendFunc(GL_ONE, GL_ONE);
+    View view = current_view;
+    use_shader(light_shader);
+    for (unsigned int i = 0; i < light_count; i++) {
+        if (lights[i].view != current_view) {
+            use_view(lights[i].view);
+        }
+        batch_sprite(light_texture, 0, 0, lights[i].instance);
+    }
+    render_flush();
+    use_view(view);
+}
+
+/* Retained mode */
+
+void Engine::set_retained_mode(bool enabled) {
+    retained_mode = enabled;
+    dirty_all = true;
+    dirty_rect_count = 0;
+}
 
-        render_position.x += font.glyph_width;
+void Engine::invalidate(ivec2 position, ivec2 size) {
+    if (!retained_mode || dirty_all) {
+        return;
     }
 
-    glBindVertexArray(0);
+    DirtyRect rect = (DirtyRect) {
+        .min = ivec2(std::max(position.x, 0), std::max(position.y, 0)),
+        .max = ivec2(std::min(position.x + size.x, (int)screen_width), std::min(position.y + size.y, (int)screen_height))
+    };
+    if (rect.min.x >= rect.max.x || rect.min.y >= rect.max.y) {
+        return;
+    }
+
+    // Merging can make the rect overlap ones already checked, so the scan starts over after each merge
+    unsigned int i = 0;
+    while (i < dirty_rect_count) {
+        const DirtyRect& other = dirty_rects[i];
+        if (rect.min.x < other.max.x && other.min.x < rect.max.x && rect.min.y < other.max.y && other.min.y < rect.max.y) {
+            rect.min = ivec2(std::min(rect.min.x, other.min.x), std::min(rect.min.y, other.min.y));
+            rect.max = ivec2(std::max(rect.max.x, other.max.x), std::max(rect.max.y, other.max.y));
+            dirty_rects[i] = dirty_rects[dirty_rect_count - 1];
+            dirty_rect_count--;
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+
+    if (dirty_rect_count == MAX_DIRTY_RECTS) {
+        for (unsigned int i = 0; i < dirty_rect_count; i++) {
+            rect.min = ivec2(std::min(rect.min.x, dirty_rects[i].min.x), std::min(rect.min.y, dirty_rects[i].min.y));
+            rect.max = ivec2(std::max(rect.max.x, dirty_rects[i].max.x), std::max(rect.max.y, dirty_rects[i].max.y));
+        }
+        dirty_rect_count = 0;
+    }
+    dirty_rects[dirty_rect_count] = rect;
+    dirty_rect_count++;
+}
+
+void Engine::invalidate_all() {
+    dirty_all = true;
+    dirty_rect_count = 0;
+}
+
+bool Engine::is_redrawn(vec2 position, vec2 size) const {
+    if (frame_dirty_all) {
+        return true;
+    }
+
+    const FrameUniforms& uniforms = frame_uniforms[current_view];
+    int min_x = (int)floorf((position.x - uniforms.view_offset[0]) * uniforms.view_zoom);
+    int min_y = (int)floorf((position.y - uniforms.view_offset[1]) * uniforms.view_zoom);
+    int max_x = (int)ceilf((position.x + size.x - uniforms.view_offset[0]) * uniforms.view_zoom);
+    int max_y = (int)ceilf((position.y + size.y - uniforms.view_offset[1]) * uniforms.view_zoom);
+    for (unsigned int i = 0; i < frame_dirty_rect_count; i++) {
+        const DirtyRect& rect = frame_dirty_rects[i];
+        if (min_x < rect.max.x && rect.min.x < max_x && min_y < rect.max.y && rect.min.y < max_y) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Post processing */
+
+bool Engine::add_post_process_pass(const char* name, Shader shader, unsigned int* pass_index) {
+    if (post_process_passes.size() == MAX_POST_PROCESS_PASSES) {
+        printf("Can't add post process pass %s, all %u passes are in use\n", name, MAX_POST_PROCESS_PASSES);
+        return false;
+    }
+
+    PostProcessPass pass;
+    pass.name = name;
+    pass.shader = shader;
+    pass.enabled = false;
+    pass.texture = 0;
+    for (unsigned int i = 0; i < POST_PROCESS_QUERY_FRAMES; i++) {
+        pass.queries[i].create("Post process timer");
+        pass.query_pending[i] = false;
+    }
+    pass.gpu_milliseconds = 0.0;
+    pass.total_gpu_milliseconds = 0.0;
+    pass.timed_frames = 0;
+    post_process_passes.push_back(std::move(pass));
+
+    use_shader(shader);
+    set_shader_uniform("source_texture", 0);
+
+    *pass_index = post_process_passes.size() - 1;
+    return true;
+}
+
+bool Engine::find_post_process_pass(const char* name, unsigned int* pass_index) const {
+    for (unsigned int i = 0; i < post_process_passes.size(); i++) {
+        if (post_process_passes[i].name == name) {
+            *pass_index = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Engine::set_post_process_enabled(unsigned int pass_index, bool enabled) {
+    post_process_passes[pass_index].enabled = enabled;
+    // The first pass to be enabled creates the targets, they're kept from then on
+    if (enabled && post_process_framebuffers[0] == 0) {
+        create_post_process_targets();
+    }
+}
+
+void Engine::create_post_process_targets() {
+    glActiveTexture(GL_TEXTURE0);
+    for (unsigned int i = 0; i < 2; i++) {
+        post_process_framebuffers[i].create("Post process framebuffer");
+        post_process_textures[i].create("Post process target");
+        post_process_textures[i].set_bytes(screen_width * screen_height * 4);
+        glBindTexture(GL_TEXTURE_2D, post_process_textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, screen_width, screen_height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindFramebuffer(GL_FRAMEBUFFER, post_process_framebuffers[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, post_process_textures[i], 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            printf("Post process framebuffer not complete!\n");
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    vram_track(post_process_framebuffers, "Post process targets", screen_width * screen_height * 4 * 2);
+}
+
+void Engine::set_post_process_texture(unsigned int pass_index, GLuint texture) {
+    post_process_passes[pass_index].texture = texture;
+}
+
+Engine::PostProcessStats Engine::post_process_stats(unsigned int pass_index) const {
+    const PostProcessPass& pass = post_process_passes[pass_index];
+    return (PostProcessStats) {
+        .name = pass.name.c_str(),
+        .enabled = pass.enabled,
+        .gpu_milliseconds = pass.gpu_milliseconds,
+        .mean_gpu_milliseconds = pass.timed_frames != 0 ? pass.total_gpu_milliseconds / pass.timed_frames : 0.0
+    };
+}
+
+void Engine::print_post_process_report() const {
+    printf("Post processing: %u passes\n", (unsigned int)post_process_passes.size());
+    for (unsigned int i = 0; i < post_process_passes.size(); i++) {
+        PostProcessStats stats = post_process_stats(i);
+        printf("    %-24s %-8s last %.3f ms, mean %.3f ms over %lu frames\n", stats.name, stats.enabled ? "enabled" : "disabled", stats.gpu_milliseconds, stats.mean_gpu_milliseconds, post_process_passes[i].timed_frames);
+    }
+}
+
+GLuint Engine::render_post_process() {
+    SIREN_ALLOCATION_SCOPE("Engine::render_post_process");
+
+    GLuint source = screen_texture;
+    unsigned int target = 0;
+    unsigned int query_slot = post_process_frame % POST_PROCESS_QUERY_FRAMES;
+    post_process_frame++;
+    for (PostProcessPass& pass : post_process_passes) {
+        if (!pass.enabled) {
+            continue;
+        }
+
+        // The query in this slot was issued POST_PROCESS_QUERY_FRAMES frames ago. If it still isn't done, this frame goes untimed rather than waiting
+        bool time_pass = true;
+        GLuint query = pass.queries[query_slot];
+        if (pass.query_pending[query_slot]) {
+            GLint available = 0;
+            glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint64 nanoseconds;
+                glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+                pass.gpu_milliseconds = (double)nanoseconds / 1000000.0;
+                pass.total_gpu_milliseconds += pass.gpu_milliseconds;
+                pass.timed_frames++;
+                pass.query_pending[query_slot] = false;
+            } else {
+                time_pass = false;
+            }
+        }
+
+        if (time_pass) {
+            glBeginQuery(GL_TIME_ELAPSED, query);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, post_process_framebuffers[target]);
+        glViewport(0, 0, screen_width, screen_height);
+        use_shader(pass.shader);
+        if (pass.texture != 0) {
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, pass.texture);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, source);
+        glBindVertexArray(quad_vao);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        glBindVertexArray(0);
+        draw_call_count++;
+        if (pass.texture != 0) {
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glActiveTexture(GL_TEXTURE0);
+        }
+        if (time_pass) {
+            glEndQuery(GL_TIME_ELAPSED);
+            pass.query_pending[query_slot] = true;
+        }
+
+        source = post_process_textures[target];
+        target = 1 - target;
+    }
     glBindTexture(GL_TEXTURE_2D, 0);
+
+    return source;
+}
+
+void Engine::render_text(Font& font, const char* text, vec2 position, Color color, TextAlign align, unsigned int max_width, float size) {
+    // Layouts are built at the font's own size, so the wrap width is scaled into those units
+    float scale = font.rendering == Font::RENDERING_SDF && size != 0.0f ? size / (float)font.size : 1.0f;
+    render_text_layout(layout_text(font, text, align, (unsigned int)((float)max_width / scale)), position, color, scale);
+}
+
+const TextLayout& Engine::layout_text(Font& font, const char* text, TextAlign align, unsigned int max_width) {
+    SIREN_ALLOCATION_SCOPE("Engine::layout_text");
+
+    return text_layouts.get(font, text, align, max_width, frame_index);
+}
+
+void Engine::render_text_layout(const TextLayout& layout, vec2 position, Color color, float scale) {
+    // Incomplete layouts are drawn with whatever glyphs fit, but one built before its glyphs were evicted would sample the wrong atlas pixels
+    if (layout.font == nullptr || layout.font_generation != layout.font->generation) {
+        return;
+    }
+
+    Font& font = *layout.font;
+    // Glyphs can overhang the layout's box by a little, so the test allows a margin of a few pixels
+    float text_scale = font.rendering == Font::RENDERING_SDF ? scale : 1.0f;
+    if (!is_redrawn(vec2(floorf(position.x) - 2.0f * text_scale, floorf(position.y) - 2.0f * text_scale), vec2((layout.size.x + 4) * text_scale, (layout.size.y + 4) * text_scale))) {
+        return;
+    }
+
+    if (font.rendering == Font::RENDERING_SDF) {
+        use_shader(text_sdf_shader);
+        if (scale != text_sdf_scale) {
+            set_shader_uniform("text_scale", scale);
+            text_sdf_scale = scale;
+        }
+    } else {
+        use_shader(text_shader);
+        scale = 1.0f;
+    }
+
+    // Mark the layout's pages as used this frame so rasterizing other glyphs can't evict them before the batch is drawn
+    for (unsigned int page = 0; page < font.page_count; page++) {
+        if ((layout.page_mask & (1u << page)) != 0) {
+            font.pages[page].last_used_frame = frame_index;
+        }
+    }
+
+    SpriteInstance instance = (SpriteInstance) {
+        .dest_position = { 0.0f, 0.0f },
+        .source_position = { 0.0f, 0.0f },
+        .size = { 0.0f, 0.0f },
+        .flip = { 0, 0 },
+        .palette = 0,
+        .padding = 0,
+        .color = { (uint8_t)(color.r * 255.0f), (uint8_t)(color.g * 255.0f), (uint8_t)(color.b * 255.0f), 255 }
+    };
+    float origin_x = floorf(position.x);
+    float origin_y = floorf(position.y);
+    for (const TextLayout::Quad& quad : layout.quads) {
+        instance.dest_position[0] = origin_x + (quad.dest_position[0] * scale);
+        instance.dest_position[1] = origin_y + (quad.dest_position[1] * scale);
+        instance.source_position[0] = quad.source_position[0];
+        instance.source_position[1] = quad.source_position[1];
+        instance.size[0] = quad.size[0];
+        instance.size[1] = quad.size[1];
+        batch_sprite(font.pages[quad.page].texture, 0, 0, instance);
+    }
 }
 
 void Engine::render_sprite_animation(const SpriteAnimation& sprite_animation, vec2 position) {
@@ -331,27 +1181,241 @@ void Engine::render_sprite_animation(const SpriteAnimation& sprite_animation, ve
 }
 
 void Engine::render_sprite(const Sprite& sprite, vec2 position, unsigned int hframe, unsigned int vframe, bool flip_h, bool flip_v) {
+    SIREN_ALLOCATION_SCOPE("Engine::render_sprite");
+
+    // Streamed sprites aren't drawn until their upload finishes
+    if (sprite.texture == 0) {
+        return;
+    }
     vec2 source_position = vec2(sprite.frame_width * hframe, sprite.frame_height * vframe);
     if (source_position.x + sprite.frame_width > sprite.width || source_position.y + sprite.frame_height > sprite.height) {
         printf("Sprite frame %u,%u is out of bounds\n", hframe, vframe);
         return;
     }
-    vec2 frame_size = vec2((float)sprite.frame_width, (float)sprite.frame_height);
+    if (!is_redrawn(vec2(floorf(position.x), floorf(position.y)), vec2((float)sprite.frame_width, (float)sprite.frame_height))) {
+        return;
+    }
+
+    batch_sprite(sprite.texture, sprite.palette, sprite.outline_mask, (SpriteInstance) {
+        .dest_position = { floorf(position.x), floorf(position.y) },
+        .source_position = { source_position.x, source_position.y },
+        .size = { (float)sprite.frame_width, (float)sprite.frame_height },
+        .flip = { (uint8_t)(flip_h ? 255 : 0), (uint8_t)(flip_v ? 255 : 0) },
+        .palette = (uint8_t)(sprite.palette != 0 ? 255 : 0),
+        .padding = 0,
+        .color = { 255, 255, 255, 255 }
+    });
+}
+
+void Engine::render_particles(const Sprite& sprite, const ParticleBatch* batches, unsigned int batch_count) {
+    SIREN_ALLOCATION_SCOPE("Engine::render_particles");
 
-    set_shader_uniform("sprite_texture", (unsigned int)0);
-    set_shader_uniform("dest_position", vec2(floorf(position.x), floorf(position.y)));
-    set_shader_uniform("dest_size", frame_size);
-    set_shader_uniform("source_position", source_position);
-    set_shader_uniform("source_size", frame_size);
-    set_shader_uniform("flip_h", flip_h);
-    set_shader_uniform("flip_v", flip_v);
+    if (sprite.texture == 0) {
+        return;
+    }
+    unsigned int particle_count = 0;
+    for (unsigned int i = 0; i < batch_count; i++) {
+        particle_count += batches[i].count;
+    }
+    if (particle_count == 0) {
+        return;
+    }
 
+    // Anything batched before has to be drawn first so the particles land on top of it
+    render_flush();
+
+    glBindBuffer(GL_ARRAY_BUFFER, particle_vbo);
+    if (particle_count > particle_vbo_capacity) {
+        unsigned int capacity = std::max(particle_vbo_capacity, 1024u);
+        while (capacity < particle_count) {
+            capacity *= 2;
+        }
+        particle_vbo_capacity = capacity;
+        glBufferData(GL_ARRAY_BUFFER, particle_vbo_capacity * sizeof(SpriteInstance), nullptr, GL_STREAM_DRAW);
+        particle_vbo.set_bytes(particle_vbo_capacity * sizeof(SpriteInstance));
+        vram_track(&particle_vbo, "Particle instance buffer", particle_vbo_capacity * sizeof(SpriteInstance));
+    }
+
+    // Invalidating the buffer lets the driver hand back fresh storage instead of waiting on last frame's draw
+    SpriteInstance* instances = (SpriteInstance*)glMapBufferRange(GL_ARRAY_BUFFER, 0, particle_count * sizeof(SpriteInstance), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (instances == nullptr) {
+        printf("Unable to map particle instance buffer\n");
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return;
+    }
+    unsigned int instance_count = 0;
+    for (unsigned int i = 0; i < batch_count; i++) {
+        const ParticleBatch& batch = batches[i];
+        SpriteInstance instance = (SpriteInstance) {
+            .dest_position = { 0.0f, 0.0f },
+            .source_position = { (float)(sprite.frame_width * batch.frame.x), (float)(sprite.frame_height * batch.frame.y) },
+            .size = { (float)sprite.frame_width, (float)sprite.frame_height },
+            .flip = { 0, 0 },
+            .palette = (uint8_t)(sprite.palette != 0 ? 255 : 0),
+            .padding = 0,
+            .color = { 255, 255, 255, 255 }
+        };
+        float offset_x = (float)(sprite.frame_width / 2);
+        float offset_y = (float)(sprite.frame_height / 2);
+        for (unsigned int j = 0; j < batch.count; j++) {
+            instance.dest_position[0] = floorf(batch.position_x[j] - offset_x);
+            instance.dest_position[1] = floorf(batch.position_y[j] - offset_y);
+            instances[instance_count] = instance;
+            instance_count++;
+        }
+    }
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (sprite.palette != 0) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, sprite.palette);
+    }
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, sprite.texture);
-    glBindVertexArray(quad_vao);
+    glBindVertexArray(particle_vao);
 
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, instance_count);
 
+    glBindVertexArray(0);
     glBindTexture(GL_TEXTURE_2D, 0);
+    if (sprite.palette != 0) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    draw_call_count++;
+}
+
+void Engine::batch_sprite(GLuint texture, GLuint palette, GLuint outline_mask, const SpriteInstance& instance) {
+    if (sprite_batch_count == MAX_BATCH_INSTANCES || (sprite_batch_count != 0 && (texture != sprite_batch_texture || palette != sprite_batch_palette || outline_mask != sprite_batch_outline_mask))) {
+        render_flush();
+    }
+    sprite_batch_texture = texture;
+    sprite_batch_palette = palette;
+    sprite_batch_outline_mask = outline_mask;
+    sprite_batch[sprite_batch_count] = instance;
+    sprite_batch_count++;
+}
+
+void Engine::setup_sprite_instance_attributes() {
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)offsetof(SpriteInstance, dest_position));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)offsetof(SpriteInstance, source_position));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)offsetof(SpriteInstance, size));
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 2, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(SpriteInstance), (void*)offsetof(SpriteInstance, flip));
+    glEnableVertexAttribArray(5);
+    glVertexAttribPointer(5, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(SpriteInstance), (void*)offsetof(SpriteInstance, color));
+    glEnableVertexAttribArray(6);
+    glVertexAttribPointer(6, 1, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(SpriteInstance), (void*)offsetof(SpriteInstance, palette));
+    for (GLuint attribute = 1; attribute <= 6; attribute++) {
+        glVertexAttribDivisor(attribute, 1);
+    }
+}
+
+void Engine::render_flush() {
+    if (sprite_batch_count == 0) {
+        return;
+    }
+
+    // Orphaning the buffer first means the driver doesn't have to wait for draws still reading the previous batch
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(sprite_batch), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sprite_batch_count * sizeof(SpriteInstance), sprite_batch);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (sprite_batch_palette != 0) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, sprite_batch_palette);
+    }
+    if (sprite_batch_outline_mask != 0) {
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, sprite_batch_outline_mask);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, sprite_batch_texture);
+    glBindVertexArray(sprite_vao);
+
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, sprite_batch_count);
+
     glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    if (sprite_batch_palette != 0) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    if (sprite_batch_outline_mask != 0) {
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    draw_call_count++;
+    sprite_batch_count = 0;
+}
+
+void Engine::submit(const CommandBuffer& commands) {
+    const uint8_t* command = commands.begin();
+    while (command != commands.end()) {
+        const CommandBuffer::CommandHeader* header = (const CommandBuffer::CommandHeader*)command;
+        const void* payload = command + sizeof(CommandBuffer::CommandHeader);
+
+        switch (header->type) {
+            case CommandBuffer::COMMAND_USE_SHADER:
+                use_shader(((const CommandBuffer::UseShaderCommand*)payload)->shader);
+                break;
+            case CommandBuffer::COMMAND_USE_DEFAULT_SHADER:
+                use_default_shader();
+                break;
+            case CommandBuffer::COMMAND_SET_UNIFORM_BOOL: {
+                const CommandBuffer::SetUniformCommand* uniform = (const CommandBuffer::SetUniformCommand*)payload;
+                set_shader_uniform(uniform->name, uniform->bool_value);
+                break;
+            }
+            case CommandBuffer::COMMAND_SET_UNIFORM_UINT: {
+                const CommandBuffer::SetUniformCommand* uniform = (const CommandBuffer::SetUniformCommand*)payload;
+                set_shader_uniform(uniform->name, uniform->uint_value);
+                break;
+            }
+            case CommandBuffer::COMMAND_SET_UNIFORM_VEC2: {
+                const CommandBuffer::SetUniformCommand* uniform = (const CommandBuffer::SetUniformCommand*)payload;
+                set_shader_uniform(uniform->name, vec2(uniform->vec2_value[0], uniform->vec2_value[1]));
+                break;
+            }
+            case CommandBuffer::COMMAND_SET_UNIFORM_IVEC2: {
+                const CommandBuffer::SetUniformCommand* uniform = (const CommandBuffer::SetUniformCommand*)payload;
+                set_shader_uniform(uniform->name, ivec2(uniform->ivec2_value[0], uniform->ivec2_value[1]));
+                break;
+            }
+            case CommandBuffer::COMMAND_SET_UNIFORM_COLOR: {
+                const CommandBuffer::SetUniformCommand* uniform = (const CommandBuffer::SetUniformCommand*)payload;
+                Color color;
+                color.r = uniform->color_value[0];
+                color.g = uniform->color_value[1];
+                color.b = uniform->color_value[2];
+                set_shader_uniform(uniform->name, color);
+                break;
+            }
+            case CommandBuffer::COMMAND_DRAW_SPRITE: {
+                const CommandBuffer::DrawSpriteCommand* draw = (const CommandBuffer::DrawSpriteCommand*)payload;
+                render_sprite(*draw->sprite, vec2(draw->position[0], draw->position[1]), draw->hframe, draw->vframe, draw->flip_h, draw->flip_v);
+                break;
+            }
+            case CommandBuffer::COMMAND_DRAW_TEXT: {
+                const CommandBuffer::DrawTextCommand* draw = (const CommandBuffer::DrawTextCommand*)payload;
+                Color color;
+                color.r = draw->color[0];
+                color.g = draw->color[1];
+                color.b = draw->color[2];
+                render_text(*draw->font, (const char*)(draw + 1), vec2(draw->position[0], draw->position[1]), color, draw->align, draw->max_width, draw->size);
+                break;
+            }
+        }
+
+        command += header->size;
+    }
 }
\ No newline at end of file
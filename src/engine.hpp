@@ -3,18 +3,29 @@
 #include "math.hpp"
 #include "color.hpp"
 #include "font.hpp"
+#include "text_layout.hpp"
 #include "sprite.hpp"
+#include "job.hpp"
+#include "command_buffer.hpp"
+#include "arena.hpp"
+#include "allocation.hpp"
+#include "input.hpp"
+#include "replay.hpp"
+#include "camera.hpp"
+#include "shader_cache.hpp"
+#include "vram.hpp"
+#include "gpu_object.hpp"
+#include "texture_streamer.hpp"
 
 #include <glad/glad.h>
 #include <SDL2/SDL.h>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <initializer_list>
 #include <unordered_map>
 
 namespace siren {
-    typedef GLuint Shader;
-
     class Engine {
     public:
         unsigned int screen_width;
@@ -22,35 +33,174 @@ namespace siren {
 
         unsigned int fps;
         float delta;
+        // Seconds of game time elapsed, the sum of every frame's delta
+        float time;
         bool running;
 
+        JobSystem jobs;
+        // Background sprite loading, uploads are made a budgeted slice at a time in render_clear()
+        TextureStreamer texture_streamer;
+
+        // Counters describing the last completed frame
+        struct FrameStats {
+            unsigned long heap_allocations;
+            unsigned long heap_bytes;
+            size_t frame_arena_bytes;
+            unsigned int draw_calls;
+            // Streamed texture data copied to the GPU
+            size_t texture_upload_bytes;
+            // Screen pixels cleared and drawn again, all of them unless in retained mode
+            unsigned long redrawn_pixels;
+            // Per scope breakdown of heap_allocations, only filled in when built with SIREN_TRACK_ALLOCATIONS
+            static const unsigned int MAX_ALLOCATION_SCOPES = 64;
+            AllocationScopeStats allocation_scopes[MAX_ALLOCATION_SCOPES];
+            unsigned int allocation_scope_count;
+        };
+        FrameStats frame_stats;
+        void print_allocation_report() const;
+
         static Engine& instance() {
             static Engine engine;
             return engine;
         }
-        bool init(const char* title, unsigned int screen_width, unsigned int screen_height);
+        // A hidden window still gets a full GL context, which is what tools like the benchmark harness need
+        bool init(const char* title, unsigned int screen_width, unsigned int screen_height, bool hidden = false);
+        // The window can also be resized by the user. The screen is shown at the largest whole number scale that fits, letterboxed
         void set_window_size(unsigned int window_width, unsigned int window_height);
+        void set_fullscreen(bool enabled);
+        bool is_fullscreen() const;
+        // Changes the resolution the game renders at, recreating the screen sized render targets. Retained mode redraws everything afterwards
+        bool set_screen_size(unsigned int screen_width, unsigned int screen_height);
         void timekeep();
         void poll_events();
+        // The frame limiter holds frames to 60 per second, disabling it also turns off vsync so frames run as fast as possible
+        void set_frame_limiter(bool enabled);
+        // When nonzero, delta is always this many seconds instead of the measured frame time
+        void set_fixed_timestep(float timestep);
+
+        // Recently laid out text, used by render_text() and layout_text()
+        TextLayoutCache text_layouts;
+
+        // Input state, updated by poll_events()
+        Input input;
+        // Input events polled this frame
+        std::vector<InputEvent> frame_events;
+        // Records each frame's delta and input events to a replay file
+        bool record_replay(const char* path);
+        // Plays a replay back instead of polling real input. Frames run unlimited with the recorded deltas and the engine stops when the replay ends
+        bool play_replay(const char* path);
+
+        // Scratch memory that stays valid until the end of the next frame, so data built during a pipelined update can still be read by its render
+        // The arena is reset in timekeep()
+        Arena& frame_arena();
 
         /* Shaders */
+        // Time spent in load_shader since init, launch twice to compare compiling against loading from the cache
+        struct ShaderStats {
+            unsigned int programs;
+            unsigned int cache_hits;
+            double milliseconds;
+        };
+        ShaderStats shader_stats;
+        void print_shader_report() const;
+
         Shader default_shader;
         bool load_shader(Shader* id, const char* vertex_path, const char* fragment_path);
         void use_shader(Shader shader);
         void use_default_shader();
         void set_shader_uniform(const char* name, bool value);
+        // Sampler uniforms have to be set with the int overload
+        void set_shader_uniform(const char* name, int value);
         void set_shader_uniform(const char* name, unsigned int value);
+        void set_shader_uniform(const char* name, float value);
         void set_shader_uniform(const char* name, vec2 value);
         void set_shader_uniform(const char* name, ivec2 value);
         void set_shader_uniform(const char* name, Color value);
 
+        /* Retained mode */
+        // The screen framebuffer keeps the last frame and render_clear() only clears the regions invalidated since then
+        // Draws are clipped to those regions and ones entirely outside them are skipped, so an idle scene costs next to nothing to draw
+        // Whatever draws has to invalidate everything that will look different before render_clear(), the old bounds of a moved sprite as well as the new
+        void set_retained_mode(bool enabled);
+        // In screen pixels. Does nothing outside retained mode
+        void invalidate(ivec2 position, ivec2 size);
+        void invalidate_all();
+
+        /* Post processing */
+        // Passes run in the order they were added when the frame is presented, each reading the last one's output from texture unit 0 as source_texture
+        // Disabled passes cost nothing, and with every pass disabled the screen is presented directly as before
+        static const unsigned int MAX_POST_PROCESS_PASSES = 8;
+        struct PostProcessStats {
+            const char* name;
+            bool enabled;
+            // GPU time of the pass, read back a few frames late so timing never stalls the pipeline
+            double gpu_milliseconds;
+            double mean_gpu_milliseconds;
+        };
+        // The shader should be loaded with post_process.vs.glsl. Passes start out disabled
+        bool add_post_process_pass(const char* name, Shader shader, unsigned int* pass_index);
+        bool find_post_process_pass(const char* name, unsigned int* pass_index) const;
+        void set_post_process_enabled(unsigned int pass_index, bool enabled);
+        // Bound to texture unit 1 while the pass runs, for lookup tables and the like
+        void set_post_process_texture(unsigned int pass_index, GLuint texture);
+        PostProcessStats post_process_stats(unsigned int pass_index) const;
+        void print_post_process_report() const;
+
+        /* Lighting */
+        // Lights add up in a lightmap 1/LIGHTMAP_DIVISOR the size of the screen, which starts each frame as the ambient light
+        // render_flip() multiplies the presented screen by the lightmap, upsampled by linear filtering, so the cost goes with the number of lights rather than screen pixels
+        static const unsigned int LIGHTMAP_DIVISOR = 4;
+        static const unsigned int MAX_LIGHTS = 1024;
+        // The lightmap is created when lighting is first enabled. While disabled the screen is presented unlit
+        void set_lighting_enabled(bool enabled);
+        // What everything is lit by away from any light, such as the sky's color for a day and night cycle. White leaves the scene as drawn
+        void set_ambient_light(Color color);
+        // Centered on position in the current view and fading out to nothing at radius. Lights are kept until render_flip() draws them, any past MAX_LIGHTS are dropped
+        void render_light(vec2 position, float radius, Color color);
+
+        /* Particles */
+        // A run of particles that are all drawn as the same sprite frame, centered on their positions
+        struct ParticleBatch {
+            ivec2 frame;
+            const float* position_x;
+            const float* position_y;
+            unsigned int count;
+        };
+        // Draws every batch as instances of one draw call in the current view, the frames all have to come from sprite
+        // Particles aren't clipped in retained mode, whatever draws them has to invalidate what they cover
+        void render_particles(const Sprite& sprite, const ParticleBatch* batches, unsigned int batch_count);
+
+        /* View */
+        enum View {
+            // Draws are positioned in screen pixels, for UI
+            VIEW_SCREEN,
+            // Draws are positioned in world pixels and transformed by the camera
+            VIEW_WORLD,
+            VIEW_COUNT
+        };
+        // Uploads the camera transform to the world slot of the frame uniform block, done once per frame before drawing the world
+        void set_camera(const Camera& camera);
+        void use_view(View view);
+
         /* Rendering functions */
         void render_clear();
         void render_flip();
-        void render_text(const Font& font, std::string text, vec2 position, Color color);
+        // Text is drawn through the layout cache, so strings that repeat frame to frame skip decoding, glyph lookups and line breaking
+        // Position is the top left of the layout's bounding box. SDF fonts can be drawn at any size, zero means the size they were loaded at
+        void render_text(Font& font, const char* text, vec2 position, Color color, TextAlign align = TEXT_ALIGN_LEFT, unsigned int max_width = 0, float size = 0.0f);
+        // Measures text through the same cache, the returned layout stays valid until the next text call
+        // Layouts are measured at the font's loaded size, scale them by the drawn size over Font::size for SDF fonts
+        const TextLayout& layout_text(Font& font, const char* text, TextAlign align = TEXT_ALIGN_LEFT, unsigned int max_width = 0);
+        // Scale only applies to SDF fonts, bitmap fonts are always drawn at their loaded size
+        void render_text_layout(const TextLayout& layout, vec2 position, Color color, float scale = 1.0f);
         
         void render_sprite_animation(const SpriteAnimation& sprite_animation, vec2 position);
         void render_sprite(const Sprite& sprite, vec2 position, unsigned int hframe = 0, unsigned int vframe = 0, bool flip_h = false, bool flip_v = false);
+        // Issues batched sprite and text draws. Changing shader state does this automatically, it's only needed before raw GL calls such as glFinish()
+        void render_flush();
+
+        // Replays a recorded command buffer. Must be called from the GL thread
+        void submit(const CommandBuffer& commands);
 
     private:
         SDL_Window* window;
@@ -58,23 +208,160 @@ namespace siren {
 
         unsigned int window_width;
         unsigned int window_height;
+        // Where the screen is drawn in the window, in window pixels from the top left. Recomputed only when the window or screen size changes
+        int present_x;
+        int present_y;
+        unsigned int present_width;
+        unsigned int present_height;
+        void update_window_layout();
 
         // Timekeeping
         const unsigned long FRAME_TIME = (unsigned long)(1000.0 / 60.0);
         unsigned long last_time;
         unsigned long last_second;
         unsigned int frames;
+        bool frame_limiter;
+        float fixed_timestep;
+
+        // Replays
+        static const unsigned int MAX_FRAME_EVENTS = 256;
+        ReplayRecorder replay_recorder;
+        ReplayPlayer replay_player;
+        unsigned long replay_start_time;
+
+        // Frame arenas
+        static const size_t FRAME_ARENA_SIZE = 1024 * 1024;
+        Arena frame_arenas[2];
+        unsigned int frame_index;
+        unsigned long last_heap_allocation_count;
+        unsigned long last_heap_allocation_bytes;
+
+        // Frame uniform block shared by every shader, matches the std140 layout of Frame in the shaders
+        // The buffer holds one aligned slot per View and use_view() binds the slot's range
+        static const GLuint FRAME_BLOCK_BINDING = 0;
+        struct FrameUniforms {
+            float screen_size[2];
+            float view_offset[2];
+            float view_zoom;
+            float time;
+            float padding[2];
+        };
+        FrameUniforms frame_uniforms[VIEW_COUNT];
+        BufferHandle frame_ubo;
+        GLint frame_slot_size;
+
+        // Sprite batch. Consecutive sprite or text draws with the same texture and shader state are drawn as instances of one quad
+        static const unsigned int MAX_BATCH_INSTANCES = 4096;
+        struct SpriteInstance {
+            float dest_position[2];
+            float source_position[2];
+            float size[2];
+            uint8_t flip[2];
+            // 255 when the texture holds palette indices
+            uint8_t palette;
+            uint8_t padding;
+            uint8_t color[4];
+        };
+        VertexArrayHandle sprite_vao;
+        BufferHandle instance_vbo;
+        SpriteInstance sprite_batch[MAX_BATCH_INSTANCES];
+        unsigned int sprite_batch_count;
+        GLuint sprite_batch_texture;
+        GLuint sprite_batch_palette;
+        GLuint sprite_batch_outline_mask;
+        unsigned int draw_call_count;
+        size_t texture_upload_byte_count;
+        // Palette textures are bound to texture unit 1, a palette of 0 means the texture holds colors. Outline masks are bound to unit 2
+        void batch_sprite(GLuint texture, GLuint palette, GLuint outline_mask, const SpriteInstance& instance);
+        // Points instance attributes 1 through 6 at the SpriteInstances in the bound array buffer
+        static void setup_sprite_instance_attributes();
+
+        // Particles get their own instance buffer, grown to fit the biggest draw so far, so any number of them goes out in one draw
+        VertexArrayHandle particle_vao;
+        BufferHandle particle_vbo;
+        unsigned int particle_vbo_capacity;
+
+        // Lighting. Lights are sprite instances drawn with the light shader, which stretches the falloff texture over the instance size
+        static const unsigned int LIGHT_TEXTURE_SIZE = 64;
+        struct Light {
+            View view;
+            SpriteInstance instance;
+        };
+        bool lighting_enabled;
+        Color ambient_light;
+        Light lights[MAX_LIGHTS];
+        unsigned int light_count;
+        TextureHandle light_texture;
+        Shader light_shader;
+        FramebufferHandle lightmap_framebuffer;
+        TextureHandle lightmap_texture;
+        unsigned int lightmap_width;
+        unsigned int lightmap_height;
+        void create_lightmap();
+        void render_lightmap();
+
+        // Quad VAO, the sprite VAO shares its vertex buffer
+        VertexArrayHandle quad_vao;
+        BufferHandle quad_vbo;
+
+        // Render targets, everything sized to the screen. They're deleted and created again when the screen size changes
+        FramebufferHandle screen_framebuffer;
+        TextureHandle screen_texture;
+        RenderbufferHandle screen_depth_stencil;
+        bool create_render_targets();
+        void destroy_render_targets();
 
-        // Quad VAO
-        GLuint quad_vao;
+        // Retained mode. Overlapping dirty rects are merged, and once there are too many they're collapsed into their bounding box
+        // One region is clipped to with the scissor test, several by clearing the stencil buffer to 1 inside them and testing against it
+        static const unsigned int MAX_DIRTY_RECTS = 16;
+        struct DirtyRect {
+            ivec2 min;
+            ivec2 max;
+        };
+        bool retained_mode;
+        bool dirty_all;
+        DirtyRect dirty_rects[MAX_DIRTY_RECTS];
+        unsigned int dirty_rect_count;
+        // What render_clear() cleared for the frame being drawn
+        bool frame_dirty_all;
+        DirtyRect frame_dirty_rects[MAX_DIRTY_RECTS];
+        unsigned int frame_dirty_rect_count;
+        unsigned long redrawn_pixel_count;
+        View current_view;
+        // False if a rect in the current view's space lies outside everything cleared this frame
+        bool is_redrawn(vec2 position, vec2 size) const;
 
-        // Renderbuffer
-        GLuint screen_framebuffer;
-        GLuint screen_texture;
+        // Post processing. Passes ping-pong between two targets the size of the screen, created when a pass is first enabled
+        // Each pass keeps a ring of timer queries, one per frame in flight
+        static const unsigned int POST_PROCESS_QUERY_FRAMES = 3;
+        struct PostProcessPass {
+            std::string name;
+            Shader shader;
+            bool enabled;
+            GLuint texture;
+            QueryHandle queries[POST_PROCESS_QUERY_FRAMES];
+            bool query_pending[POST_PROCESS_QUERY_FRAMES];
+            double gpu_milliseconds;
+            double total_gpu_milliseconds;
+            unsigned long timed_frames;
+        };
+        std::vector<PostProcessPass> post_process_passes;
+        FramebufferHandle post_process_framebuffers[2];
+        TextureHandle post_process_textures[2];
+        unsigned int post_process_frame;
+        void create_post_process_targets();
+        // Runs the enabled passes over the screen texture and returns the texture to present
+        GLuint render_post_process();
 
+        ShaderCache shader_cache;
+        // Every program load_shader() made. Shader is a plain id, so these are what delete them
+        std::vector<ProgramHandle> programs;
         Shader current_shader;
         Shader screen_shader;
         Shader text_shader;
+        Shader text_sdf_shader;
+        // Last text_scale given to text_sdf_shader, so runs of text at one size don't break the batch
+        float text_sdf_scale;
 
         Engine() {}; // constructor
         ~Engine(); // destructor
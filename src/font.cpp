@@ -1,75 +1,427 @@
 #include "font.hpp"
 
+#include "allocation.hpp"
+#include "vram.hpp"
+
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 #include <cstdio>
+#include <algorithm>
+#include <cmath>
 
 using namespace siren;
 
-int next_largest_power_of_two(int number) {
-    int power_of_two = 1;
-    while (power_of_two < number) {
-        power_of_two *= 2;
+// Generations are unique across every font, so a font reloaded at the same address doesn't look unchanged
+static uint32_t next_generation = 1;
+
+uint32_t siren::utf8_next(const char** text) {
+    static const uint32_t MIN_CODEPOINT[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+
+    const uint8_t* bytes = (const uint8_t*)*text;
+    uint32_t codepoint;
+    unsigned int length;
+    if (bytes[0] < 0x80) {
+        codepoint = bytes[0];
+        length = 1;
+    } else if ((bytes[0] & 0xE0) == 0xC0) {
+        codepoint = bytes[0] & 0x1F;
+        length = 2;
+    } else if ((bytes[0] & 0xF0) == 0xE0) {
+        codepoint = bytes[0] & 0x0F;
+        length = 3;
+    } else if ((bytes[0] & 0xF8) == 0xF0) {
+        codepoint = bytes[0] & 0x07;
+        length = 4;
+    } else {
+        *text += 1;
+        return REPLACEMENT_CHARACTER;
+    }
+
+    for (unsigned int i = 1; i < length; i++) {
+        // This also stops at the null terminator of a truncated sequence
+        if ((bytes[i] & 0xC0) != 0x80) {
+            *text += i;
+            return REPLACEMENT_CHARACTER;
+        }
+        codepoint = (codepoint << 6) | (bytes[i] & 0x3F);
+    }
+    *text += length;
+
+    // Overlong encodings, UTF-16 surrogates and values past the last plane aren't valid
+    if (codepoint < MIN_CODEPOINT[length] || (codepoint >= 0xD800 && codepoint <= 0xDFFF) || codepoint > 0x10FFFF) {
+        return REPLACEMENT_CHARACTER;
     }
 
-    return power_of_two;
+    return codepoint;
 }
 
-bool Font::load(const char* path, unsigned int size) {
-    static const SDL_Color SDL_COLOR_WHITE = { 255, 255, 255, 255 };
+bool Font::load(const char* path, unsigned int size, Rendering rendering) {
+    SIREN_ALLOCATION_SCOPE("Font::load");
 
-    // Load the font
-    TTF_Font* ttf_font = TTF_OpenFont(path, size);
+    // The font stays open so that glyphs can be rasterized as they're needed
+    this->rendering = rendering;
+    this->size = size;
+    ttf_font = TTF_OpenFont(path, rendering == RENDERING_SDF ? size * SDF_OVERSAMPLE : size);
     if (ttf_font == NULL) {
         printf("Unable to open font at path %s. SDL Error: %s\n", path, TTF_GetError());
         return false;
     }
 
-    // Render each glyph to a surface
-    SDL_Surface* glyphs[96];
-    int max_width;
-    int max_height;
-    for (int i = 0; i < 96; i++) {
-        char text[2] = { (char)(i + FIRST_CHAR), '\0' };
-        glyphs[i] = TTF_RenderText_Solid(ttf_font, text, SDL_COLOR_WHITE);
-        if (glyphs[i] == NULL) {
+    line_height = (unsigned int)TTF_FontHeight(ttf_font);
+    if (rendering == RENDERING_SDF) {
+        line_height = (line_height + (SDF_OVERSAMPLE / 2)) / SDF_OVERSAMPLE;
+    }
+    page_count = 0;
+    evictions = 0;
+    generation = next_generation++;
+    glyphs.clear();
+    if (!add_page()) {
+        return false;
+    }
+
+    // Printable ASCII is nearly always needed, so it's cached up front
+    for (uint32_t codepoint = 32; codepoint < 127; codepoint++) {
+        if (glyph(codepoint, 0) == nullptr) {
             return false;
         }
+    }
+
+    return true;
+}
+
+void Font::unload() {
+    for (unsigned int i = 0; i < page_count; i++) {
+        pages[i].texture.reset();
+        vram_untrack(&pages[i]);
+        pages[i].shelves.clear();
+        pages[i].codepoints.clear();
+    }
+    page_count = 0;
+    glyphs.clear();
+    generation = next_generation++;
+
+    TTF_CloseFont(ttf_font);
+    ttf_font = nullptr;
+}
+
+const Font::Glyph* Font::glyph(uint32_t codepoint, unsigned int frame) {
+    std::unordered_map<uint32_t, Glyph>::iterator it = glyphs.find(codepoint);
+    if (it == glyphs.end()) {
+        SIREN_ALLOCATION_SCOPE("Font::glyph");
+
+        // Codepoints the font lacks share the cached replacement glyph instead of each packing their own copy
+        Glyph new_glyph;
+        uint32_t provided_codepoint = codepoint;
+        if (codepoint > 0xFFFF || !TTF_GlyphIsProvided(ttf_font, (Uint16)codepoint)) {
+            provided_codepoint = TTF_GlyphIsProvided(ttf_font, (Uint16)REPLACEMENT_CHARACTER) ? REPLACEMENT_CHARACTER : '?';
+        }
+        if (provided_codepoint != codepoint) {
+            const Glyph* replacement = glyph(provided_codepoint, frame);
+            if (replacement == nullptr) {
+                return nullptr;
+            }
+            new_glyph = *replacement;
+        } else if (!rasterize(codepoint, frame, &new_glyph)) {
+            return nullptr;
+        }
 
-        if (i == 0 || max_width < glyphs[i]->w) {
-            max_width = glyphs[i]->w;
+        it = glyphs.insert(std::make_pair(codepoint, new_glyph)).first;
+        if (new_glyph.width != 0) {
+            pages[new_glyph.page].codepoints.push_back(codepoint);
         }
-        if (i == 0 || max_height < glyphs[i]->h) {
-            max_height = glyphs[i]->h;
+    }
+
+    if (it->second.width != 0) {
+        pages[it->second.page].last_used_frame = frame;
+    }
+
+    return &it->second;
+}
+
+int Font::kerning(uint32_t previous, uint32_t codepoint) const {
+    // SDL_ttf's glyph functions only take codepoints from the basic multilingual plane
+    if (previous > 0xFFFF || codepoint > 0xFFFF) {
+        return 0;
+    }
+
+    int kerning = TTF_GetFontKerningSizeGlyphs(ttf_font, (Uint16)previous, (Uint16)codepoint);
+    if (rendering == RENDERING_SDF) {
+        return (int)roundf((float)kerning / (float)SDF_OVERSAMPLE);
+    }
+
+    return kerning;
+}
+
+bool Font::rasterize(uint32_t codepoint, unsigned int frame, Glyph* glyph) {
+    static const SDL_Color SDL_COLOR_WHITE = { 255, 255, 255, 255 };
+
+    int advance;
+    if (TTF_GlyphMetrics(ttf_font, (Uint16)codepoint, nullptr, nullptr, nullptr, nullptr, &advance) != 0) {
+        printf("Error getting metrics of glyph U+%04X: %s\n", codepoint, TTF_GetError());
+        return false;
+    }
+
+    // A solid glyph surface is one line tall with the glyph already at its baseline. Color 0 is the background
+    SDL_Surface* surface = TTF_RenderGlyph_Solid(ttf_font, (Uint16)codepoint, SDL_COLOR_WHITE);
+    if (surface == nullptr) {
+        printf("Error rendering glyph U+%04X: %s\n", codepoint, TTF_GetError());
+        return false;
+    }
+
+    // Only the inked pixels are packed
+    int min_x = surface->w;
+    int min_y = surface->h;
+    int max_x = -1;
+    int max_y = -1;
+    for (int y = 0; y < surface->h; y++) {
+        const uint8_t* row = (const uint8_t*)surface->pixels + (y * surface->pitch);
+        for (int x = 0; x < surface->w; x++) {
+            if (row[x] != 0) {
+                min_x = std::min(min_x, x);
+                max_x = std::max(max_x, x);
+                min_y = std::min(min_y, y);
+                max_y = std::max(max_y, y);
+            }
         }
     }
 
-    int atlas_width = next_largest_power_of_two(max_width * 96);
-    int atlas_height = next_largest_power_of_two(max_height);
-    SDL_Surface* atlas_surface = SDL_CreateRGBSurface(0, atlas_width, atlas_height, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000);
-    for (int i = 0; i < 96; i++) {
-        SDL_Rect dest_rect = {  max_width * i, 0, glyphs[i]->w, glyphs[i]->h };
-        SDL_BlitSurface(glyphs[i], NULL, atlas_surface, &dest_rect);
+    glyph->advance = rendering == RENDERING_SDF ? (int16_t)roundf((float)advance / (float)SDF_OVERSAMPLE) : (int16_t)advance;
+    glyph->page = 0;
+    glyph->x = 0;
+    glyph->y = 0;
+    glyph->width = 0;
+    glyph->height = 0;
+    glyph->offset_x = 0;
+    glyph->offset_y = 0;
+    if (max_x < 0) {
+        SDL_FreeSurface(surface);
+        return true;
     }
 
-    // Generate OpenGL texture
-    glGenTextures(1, &atlas);
-    glBindTexture(GL_TEXTURE_2D, atlas);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, atlas_width, atlas_height, 0, GL_BGRA, GL_UNSIGNED_BYTE, atlas_surface->pixels);
+    if (rendering == RENDERING_SDF) {
+        // The stored glyph covers the inked pixels scaled down, plus the spread on every side so the field can fade out
+        int origin_x = (int)floorf((float)min_x / (float)SDF_OVERSAMPLE) - (int)SDF_SPREAD;
+        int origin_y = (int)floorf((float)min_y / (float)SDF_OVERSAMPLE) - (int)SDF_SPREAD;
+        unsigned int width = (unsigned int)(((max_x + SDF_OVERSAMPLE) / SDF_OVERSAMPLE) + SDF_SPREAD - origin_x);
+        unsigned int height = (unsigned int)(((max_y + SDF_OVERSAMPLE) / SDF_OVERSAMPLE) + SDF_SPREAD - origin_y);
+        if (!allocate(width, height, frame, glyph)) {
+            SDL_FreeSurface(surface);
+            return false;
+        }
+        glyph->offset_x = (int16_t)origin_x;
+        glyph->offset_y = (int16_t)origin_y;
+        build_distance_field(surface, origin_x, origin_y, width, height);
+    } else {
+        unsigned int width = (unsigned int)(max_x - min_x + 1);
+        unsigned int height = (unsigned int)(max_y - min_y + 1);
+        if (!allocate(width, height, frame, glyph)) {
+            SDL_FreeSurface(surface);
+            return false;
+        }
+        glyph->offset_x = (int16_t)min_x;
+        glyph->offset_y = (int16_t)min_y;
 
-    // Finish setting up font struct
-    glyph_width = (unsigned int)max_width;
-    glyph_height = (unsigned int)max_height;
+        upload_buffer.resize(width * height);
+        for (unsigned int y = 0; y < height; y++) {
+            const uint8_t* row = (const uint8_t*)surface->pixels + ((min_y + y) * surface->pitch) + min_x;
+            for (unsigned int x = 0; x < width; x++) {
+                upload_buffer[x + (y * width)] = row[x] != 0 ? 255 : 0;
+            }
+        }
+    }
+    SDL_FreeSurface(surface);
 
-    // Cleanup
+    glBindTexture(GL_TEXTURE_2D, pages[glyph->page].texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, glyph->x, glyph->y, glyph->width, glyph->height, GL_RED, GL_UNSIGNED_BYTE, &upload_buffer[0]);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     glBindTexture(GL_TEXTURE_2D, 0);
-    for (int i = 0; i < 96; i++) {
-        SDL_FreeSurface(glyphs[i]);
+
+    return true;
+}
+
+// Felzenszwalb and Huttenlocher's squared euclidean distance transform along one row or column
+// values holds 0 at feature pixels and a large number elsewhere, and is overwritten with the squared distance to the nearest feature
+static void distance_transform_1d(float* values, unsigned int count, unsigned int stride, float* scratch) {
+    static const float INFINITE_DISTANCE = 1e20f;
+
+    float* f = scratch;
+    int* v = (int*)(scratch + count);
+    float* z = scratch + (count * 2);
+    for (unsigned int i = 0; i < count; i++) {
+        f[i] = values[i * stride];
+    }
+
+    // Lower envelope of the parabolas rooted at each pixel
+    int k = 0;
+    v[0] = 0;
+    z[0] = -INFINITE_DISTANCE;
+    z[1] = INFINITE_DISTANCE;
+    for (int q = 1; q < (int)count; q++) {
+        float s = ((f[q] + (q * q)) - (f[v[k]] + (v[k] * v[k]))) / (2 * q - 2 * v[k]);
+        while (s <= z[k]) {
+            k--;
+            s = ((f[q] + (q * q)) - (f[v[k]] + (v[k] * v[k]))) / (2 * q - 2 * v[k]);
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = INFINITE_DISTANCE;
+    }
+
+    k = 0;
+    for (int q = 0; q < (int)count; q++) {
+        while (z[k + 1] < q) {
+            k++;
+        }
+        values[q * stride] = ((q - v[k]) * (q - v[k])) + f[v[k]];
+    }
+}
+
+static void distance_transform_2d(float* values, unsigned int width, unsigned int height, float* scratch) {
+    for (unsigned int x = 0; x < width; x++) {
+        distance_transform_1d(values + x, height, width, scratch);
+    }
+    for (unsigned int y = 0; y < height; y++) {
+        distance_transform_1d(values + (y * width), width, 1, scratch);
+    }
+}
+
+void Font::build_distance_field(const SDL_Surface* surface, int origin_x, int origin_y, unsigned int width, unsigned int height) {
+    static const float FAR = 1e20f;
+
+    // Work at the oversampled resolution over the stored glyph's area
+    unsigned int field_width = width * SDF_OVERSAMPLE;
+    unsigned int field_height = height * SDF_OVERSAMPLE;
+    int field_x = origin_x * (int)SDF_OVERSAMPLE;
+    int field_y = origin_y * (int)SDF_OVERSAMPLE;
+    sdf_inside.resize(field_width * field_height);
+    sdf_outside.resize(field_width * field_height);
+    for (unsigned int y = 0; y < field_height; y++) {
+        int surface_y = field_y + (int)y;
+        for (unsigned int x = 0; x < field_width; x++) {
+            int surface_x = field_x + (int)x;
+            bool inside = surface_x >= 0 && surface_y >= 0 && surface_x < surface->w && surface_y < surface->h &&
+                ((const uint8_t*)surface->pixels)[surface_x + (surface_y * surface->pitch)] != 0;
+            // sdf_inside ends up as each pixel's distance to the glyph, sdf_outside as its distance to the background
+            sdf_inside[x + (y * field_width)] = inside ? 0.0f : FAR;
+            sdf_outside[x + (y * field_width)] = inside ? FAR : 0.0f;
+        }
+    }
+
+    sdf_scratch.resize((std::max(field_width, field_height) * 3) + 1);
+    distance_transform_2d(&sdf_inside[0], field_width, field_height, &sdf_scratch[0]);
+    distance_transform_2d(&sdf_outside[0], field_width, field_height, &sdf_scratch[0]);
+
+    // Each stored pixel takes the field at the middle of its oversampled block. 0.5 is the edge and values fall off to 0 at SDF_SPREAD pixels outside it
+    upload_buffer.resize(width * height);
+    for (unsigned int y = 0; y < height; y++) {
+        for (unsigned int x = 0; x < width; x++) {
+            unsigned int index = ((x * SDF_OVERSAMPLE) + (SDF_OVERSAMPLE / 2)) + (((y * SDF_OVERSAMPLE) + (SDF_OVERSAMPLE / 2)) * field_width);
+            float distance = sdf_inside[index] != 0.0f ? sqrtf(sdf_inside[index]) - 0.5f : -(sqrtf(sdf_outside[index]) - 0.5f);
+            float value = 0.5f - (distance / (float)(SDF_OVERSAMPLE * SDF_SPREAD * 2));
+            upload_buffer[x + (y * width)] = (uint8_t)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f);
+        }
+    }
+}
+
+bool Font::allocate(unsigned int width, unsigned int height, unsigned int frame, Glyph* glyph) {
+    if (width + GLYPH_PADDING > PAGE_SIZE || height + GLYPH_PADDING > PAGE_SIZE) {
+        printf("Glyph of %ux%u doesn't fit in a font page\n", width, height);
+        return false;
+    }
+
+    for (unsigned int i = 0; i < page_count; i++) {
+        if (allocate_in_page(i, width, height, glyph)) {
+            return true;
+        }
     }
-    SDL_FreeSurface(atlas_surface);
-    TTF_CloseFont(ttf_font);
+
+    if (page_count < MAX_PAGES) {
+        return add_page() && allocate_in_page(page_count - 1, width, height, glyph);
+    }
+
+    // Evict the least recently used page that hasn't been drawn from this frame
+    unsigned int evict_index = MAX_PAGES;
+    for (unsigned int i = 0; i < page_count; i++) {
+        if (pages[i].last_used_frame != frame && (evict_index == MAX_PAGES || pages[i].last_used_frame < pages[evict_index].last_used_frame)) {
+            evict_index = i;
+        }
+    }
+    if (evict_index == MAX_PAGES) {
+        return false;
+    }
+    evict_page(evict_index);
+
+    return allocate_in_page(evict_index, width, height, glyph);
+}
+
+bool Font::allocate_in_page(unsigned int page_index, unsigned int width, unsigned int height, Glyph* glyph) {
+    Page& page = pages[page_index];
+    unsigned int padded_width = width + GLYPH_PADDING;
+    unsigned int padded_height = height + GLYPH_PADDING;
+
+    // Use the shortest shelf the glyph fits on, so short glyphs don't waste space on tall shelves
+    Shelf* best_shelf = nullptr;
+    for (Shelf& shelf : page.shelves) {
+        if (shelf.height >= padded_height && shelf.x + padded_width <= PAGE_SIZE && (best_shelf == nullptr || shelf.height < best_shelf->height)) {
+            best_shelf = &shelf;
+        }
+    }
+
+    if (best_shelf == nullptr) {
+        unsigned int shelf_y = page.shelves.empty() ? 0 : page.shelves.back().y + page.shelves.back().height;
+        if (shelf_y + padded_height > PAGE_SIZE) {
+            return false;
+        }
+        page.shelves.push_back((Shelf) {
+            .y = (uint16_t)shelf_y,
+            .height = (uint16_t)padded_height,
+            .x = 0
+        });
+        best_shelf = &page.shelves.back();
+    }
+
+    glyph->page = (uint16_t)page_index;
+    glyph->x = best_shelf->x;
+    glyph->y = best_shelf->y;
+    glyph->width = (uint16_t)width;
+    glyph->height = (uint16_t)height;
+    best_shelf->x += padded_width;
 
     return true;
+}
+
+bool Font::add_page() {
+    Page& page = pages[page_count];
+    page.texture.create("Font page");
+    glBindTexture(GL_TEXTURE_2D, page.texture);
+    // Distance fields are filtered, that's what keeps their edges smooth at any scale
+    GLint filter = rendering == RENDERING_SDF ? GL_LINEAR : GL_NEAREST;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, PAGE_SIZE, PAGE_SIZE, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    page.shelves.clear();
+    page.codepoints.clear();
+    page.last_used_frame = 0;
+    page_count++;
+    page.texture.set_bytes(PAGE_SIZE * PAGE_SIZE);
+    vram_track(&page, "Font page", PAGE_SIZE * PAGE_SIZE);
+
+    return true;
+}
+
+void Font::evict_page(unsigned int page_index) {
+    Page& page = pages[page_index];
+    for (uint32_t codepoint : page.codepoints) {
+        glyphs.erase(codepoint);
+    }
+    page.codepoints.clear();
+    page.shelves.clear();
+    evictions++;
+    generation = next_generation++;
 }
\ No newline at end of file
@@ -2,17 +2,98 @@
 
 #include "math.hpp"
 #include "color.hpp"
+#include "gpu_object.hpp"
 #include <glad/glad.h>
+#include <SDL2/SDL_ttf.h>
+#include <cstdint>
 #include <string>
+#include <vector>
+#include <unordered_map>
 
 namespace siren {
+    static const uint32_t REPLACEMENT_CHARACTER = 0xFFFD;
+
+    // Decodes the UTF-8 codepoint at *text and advances past it. Malformed sequences decode to REPLACEMENT_CHARACTER
+    uint32_t utf8_next(const char** text);
+
+    // Glyphs are rasterized the first time they're drawn and shelf packed into atlas pages
+    // Once every page is full, the least recently used page is cleared to make room
     struct Font {
-        static const int FIRST_CHAR = 32;
+        static const unsigned int PAGE_SIZE = 256;
+        static const unsigned int MAX_PAGES = 4;
+        // Empty pixels left between packed glyphs
+        static const unsigned int GLYPH_PADDING = 1;
+
+        enum Rendering : uint8_t {
+            // One bit coverage at the loaded size, pixel exact but only good at that size
+            RENDERING_BITMAP,
+            // Signed distance fields that can be drawn at any size, the loaded size is the size the fields are stored at
+            RENDERING_SDF
+        };
+        // SDF glyphs are rasterized this many times larger than they're stored, then the distance field is sampled down
+        static const unsigned int SDF_OVERSAMPLE = 4;
+        // Distance in stored pixels covered by the field on each side of a glyph's edge, which is also the border added around it
+        static const unsigned int SDF_SPREAD = 4;
+
+        struct Glyph {
+            // Inked pixels of the glyph in its page, whitespace has a width and height of zero
+            uint16_t page;
+            uint16_t x;
+            uint16_t y;
+            uint16_t width;
+            uint16_t height;
+            // Offset of the inked pixels from the pen position, which is at the top left of the line
+            int16_t offset_x;
+            int16_t offset_y;
+            int16_t advance;
+        };
+
+        struct Shelf {
+            uint16_t y;
+            uint16_t height;
+            // Where the next glyph on the shelf goes
+            uint16_t x;
+        };
+
+        struct Page {
+            TextureHandle texture;
+            std::vector<Shelf> shelves;
+            // Codepoints whose glyphs are in this page, so they can be dropped when it's evicted
+            std::vector<uint32_t> codepoints;
+            unsigned int last_used_frame;
+        };
+
+        TTF_Font* ttf_font;
+        Rendering rendering;
+        unsigned int size;
+        unsigned int line_height;
+        Page pages[MAX_PAGES];
+        unsigned int page_count;
+        std::unordered_map<uint32_t, Glyph> glyphs;
+        unsigned long evictions;
+        // Changes whenever cached glyphs move or go away, on load, unload and every eviction, so anything holding glyph positions knows to rebuild
+        uint32_t generation;
+
+        bool load(const char* path, unsigned int size, Rendering rendering = RENDERING_BITMAP);
+        void unload();
+        // Returns the glyph for a codepoint, rasterizing it on first use. Codepoints the font lacks are drawn as REPLACEMENT_CHARACTER
+        // Pages used during frame are never evicted, because batched draws may still read them. If nothing can be evicted this returns nullptr
+        const Glyph* glyph(uint32_t codepoint, unsigned int frame);
+        // Extra advance between two codepoints drawn next to each other
+        int kerning(uint32_t previous, uint32_t codepoint) const;
 
-        GLuint atlas;
-        unsigned int glyph_width;
-        unsigned int glyph_height;
+    private:
+        std::vector<uint8_t> upload_buffer;
+        // Scratch space for building distance fields
+        std::vector<float> sdf_inside;
+        std::vector<float> sdf_outside;
+        std::vector<float> sdf_scratch;
 
-        bool load(const char* path, unsigned int size);
+        bool rasterize(uint32_t codepoint, unsigned int frame, Glyph* glyph);
+        void build_distance_field(const SDL_Surface* surface, int origin_x, int origin_y, unsigned int width, unsigned int height);
+        bool allocate(unsigned int width, unsigned int height, unsigned int frame, Glyph* glyph);
+        bool allocate_in_page(unsigned int page_index, unsigned int width, unsigned int height, Glyph* glyph);
+        bool add_page();
+        void evict_page(unsigned int page_index);
     };
 }
\ No newline at end of file
@@ -0,0 +1,144 @@
+#include "gpu_object.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace siren;
+
+struct GpuObject {
+    GpuObjectType type;
+    GLuint id;
+    std::string name;
+    size_t bytes;
+};
+
+static const char* GPU_OBJECT_TYPE_NAMES[GPU_OBJECT_TYPE_COUNT] = {
+    "Texture",
+    "Buffer",
+    "Program",
+    "Framebuffer",
+    "Renderbuffer",
+    "Vertex array",
+    "Query"
+};
+
+static std::vector<GpuObject> gpu_objects;
+// Once the context is gone its objects went with it, there's nothing left to delete
+static bool gpu_context_released = false;
+
+static std::vector<GpuObject>::iterator gpu_object_find(GpuObjectType type, GLuint id) {
+    return std::find_if(gpu_objects.begin(), gpu_objects.end(), [type, id](const GpuObject& object) {
+        return object.type == type && object.id == id;
+    });
+}
+
+GLuint siren::gpu_object_create(GpuObjectType type, const char* name) {
+    GLuint id = 0;
+    switch (type) {
+        case GPU_OBJECT_TEXTURE:
+            glGenTextures(1, &id);
+            break;
+        case GPU_OBJECT_BUFFER:
+            glGenBuffers(1, &id);
+            break;
+        case GPU_OBJECT_PROGRAM:
+            id = glCreateProgram();
+            break;
+        case GPU_OBJECT_FRAMEBUFFER:
+            glGenFramebuffers(1, &id);
+            break;
+        case GPU_OBJECT_RENDERBUFFER:
+            glGenRenderbuffers(1, &id);
+            break;
+        case GPU_OBJECT_VERTEX_ARRAY:
+            glGenVertexArrays(1, &id);
+            break;
+        case GPU_OBJECT_QUERY:
+            glGenQueries(1, &id);
+            break;
+        case GPU_OBJECT_TYPE_COUNT:
+            break;
+    }
+    gpu_object_track(type, id, name);
+
+    return id;
+}
+
+void siren::gpu_object_track(GpuObjectType type, GLuint id, const char* name) {
+    gpu_objects.push_back((GpuObject) {
+        .type = type,
+        .id = id,
+        .name = name,
+        .bytes = 0
+    });
+}
+
+void siren::gpu_object_set_bytes(GpuObjectType type, GLuint id, size_t bytes) {
+    std::vector<GpuObject>::iterator it = gpu_object_find(type, id);
+    if (it != gpu_objects.end()) {
+        it->bytes = bytes;
+    }
+}
+
+void siren::gpu_object_delete(GpuObjectType type, GLuint id) {
+    std::vector<GpuObject>::iterator it = gpu_object_find(type, id);
+    if (it != gpu_objects.end()) {
+        gpu_objects.erase(it);
+    }
+    if (gpu_context_released) {
+        return;
+    }
+
+    switch (type) {
+        case GPU_OBJECT_TEXTURE:
+            glDeleteTextures(1, &id);
+            break;
+        case GPU_OBJECT_BUFFER:
+            glDeleteBuffers(1, &id);
+            break;
+        case GPU_OBJECT_PROGRAM:
+            glDeleteProgram(id);
+            break;
+        case GPU_OBJECT_FRAMEBUFFER:
+            glDeleteFramebuffers(1, &id);
+            break;
+        case GPU_OBJECT_RENDERBUFFER:
+            glDeleteRenderbuffers(1, &id);
+            break;
+        case GPU_OBJECT_VERTEX_ARRAY:
+            glDeleteVertexArrays(1, &id);
+            break;
+        case GPU_OBJECT_QUERY:
+            glDeleteQueries(1, &id);
+            break;
+        case GPU_OBJECT_TYPE_COUNT:
+            break;
+    }
+}
+
+unsigned int siren::gpu_object_count() {
+    return gpu_objects.size();
+}
+
+void siren::gpu_print_object_report() {
+    size_t total_bytes = 0;
+    for (const GpuObject& object : gpu_objects) {
+        total_bytes += object.bytes;
+    }
+
+    printf("GPU objects: %zu live holding %.1f KB\n", gpu_objects.size(), total_bytes / 1024.0);
+    for (const GpuObject& object : gpu_objects) {
+        printf("    %-12s %6u  %-36s %10.1f KB\n", GPU_OBJECT_TYPE_NAMES[object.type], object.id, object.name.c_str(), object.bytes / 1024.0);
+    }
+}
+
+void siren::gpu_objects_release_context() {
+    if (!gpu_objects.empty()) {
+        printf("GPU objects leaked at shutdown\n");
+        gpu_print_object_report();
+    }
+    gpu_objects.clear();
+    gpu_context_released = true;
+}
\ No newline at end of file
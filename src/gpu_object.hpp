@@ -0,0 +1,93 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+
+namespace siren {
+    // Every GL object the engine creates goes through these, so what's still alive can be listed at any time and anything left at shutdown is reported as a leak
+    // Only called from the GL thread
+    enum GpuObjectType {
+        GPU_OBJECT_TEXTURE,
+        GPU_OBJECT_BUFFER,
+        GPU_OBJECT_PROGRAM,
+        GPU_OBJECT_FRAMEBUFFER,
+        GPU_OBJECT_RENDERBUFFER,
+        GPU_OBJECT_VERTEX_ARRAY,
+        GPU_OBJECT_QUERY,
+        GPU_OBJECT_TYPE_COUNT
+    };
+
+    // Generates an object and records it under name, which is copied
+    GLuint gpu_object_create(GpuObjectType type, const char* name);
+    // Records an object that was made some other way
+    void gpu_object_track(GpuObjectType type, GLuint id, const char* name);
+    // Bytes of storage the object holds, shown in the report
+    void gpu_object_set_bytes(GpuObjectType type, GLuint id, size_t bytes);
+    void gpu_object_delete(GpuObjectType type, GLuint id);
+    unsigned int gpu_object_count();
+    void gpu_print_object_report();
+    // Called when the GL context goes away. Prints a leak report if anything is still alive, and from then on deleting an object only forgets it
+    void gpu_objects_release_context();
+
+    // Owns one GL object and deletes it when destroyed or reset. Handles can be moved but not copied
+    // They convert to GLuint, so a handle can be passed straight to GL calls that take the object
+    template <GpuObjectType TYPE>
+    class GpuHandle {
+    public:
+        GpuHandle() : id(0) {}
+        ~GpuHandle() {
+            reset();
+        }
+        GpuHandle(const GpuHandle&) = delete;
+        GpuHandle(GpuHandle&& other) : id(other.id) {
+            other.id = 0;
+        }
+        GpuHandle& operator=(const GpuHandle&) = delete;
+        GpuHandle& operator=(GpuHandle&& other) {
+            if (this != &other) {
+                reset();
+                id = other.id;
+                other.id = 0;
+            }
+            return *this;
+        }
+
+        // Deletes whatever the handle held before creating the new object
+        void create(const char* name) {
+            reset();
+            id = gpu_object_create(TYPE, name);
+        }
+        // Takes ownership of an object made elsewhere, such as by glCreateProgram()
+        void adopt(GLuint id, const char* name) {
+            reset();
+            this->id = id;
+            gpu_object_track(TYPE, id, name);
+        }
+        void set_bytes(size_t bytes) const {
+            gpu_object_set_bytes(TYPE, id, bytes);
+        }
+        void reset() {
+            if (id != 0) {
+                gpu_object_delete(TYPE, id);
+                id = 0;
+            }
+        }
+        GLuint get() const {
+            return id;
+        }
+        operator GLuint() const {
+            return id;
+        }
+
+    private:
+        GLuint id;
+    };
+
+    typedef GpuHandle<GPU_OBJECT_TEXTURE> TextureHandle;
+    typedef GpuHandle<GPU_OBJECT_BUFFER> BufferHandle;
+    typedef GpuHandle<GPU_OBJECT_PROGRAM> ProgramHandle;
+    typedef GpuHandle<GPU_OBJECT_FRAMEBUFFER> FramebufferHandle;
+    typedef GpuHandle<GPU_OBJECT_RENDERBUFFER> RenderbufferHandle;
+    typedef GpuHandle<GPU_OBJECT_VERTEX_ARRAY> VertexArrayHandle;
+    typedef GpuHandle<GPU_OBJECT_QUERY> QueryHandle;
+}
\ No newline at end of file
@@ -0,0 +1,193 @@
+#include "input.hpp"
+
+#include <cmath>
+#include <cstdio>
+
+using namespace siren;
+
+bool siren::input_event_from_sdl(const SDL_Event& e, InputEvent* event) {
+    event->repeat = 0;
+    event->code = 0;
+    event->x = 0;
+    event->y = 0;
+
+    switch (e.type) {
+        case SDL_QUIT:
+            event->type = InputEvent::QUIT;
+            return true;
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+            event->type = e.type == SDL_KEYDOWN ? InputEvent::KEY_DOWN : InputEvent::KEY_UP;
+            event->repeat = e.key.repeat;
+            event->code = (uint16_t)e.key.keysym.scancode;
+            return true;
+        case SDL_MOUSEMOTION:
+            event->type = InputEvent::MOUSE_MOTION;
+            event->x = e.motion.x;
+            event->y = e.motion.y;
+            return true;
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+            event->type = e.type == SDL_MOUSEBUTTONDOWN ? InputEvent::MOUSE_BUTTON_DOWN : InputEvent::MOUSE_BUTTON_UP;
+            event->code = e.button.button;
+            event->x = e.button.x;
+            event->y = e.button.y;
+            return true;
+        case SDL_MOUSEWHEEL:
+            event->type = InputEvent::MOUSE_WHEEL;
+            event->x = e.wheel.x;
+            event->y = e.wheel.y;
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Input state */
+
+Input::Input() {
+    for (unsigned int i = 0; i < KEY_COUNT / 64; i++) {
+        keys[i] = 0;
+        previous_keys[i] = 0;
+    }
+    mouse_buttons = 0;
+    previous_mouse_buttons = 0;
+    window_mouse_position = ivec2(0, 0);
+    wheel = ivec2(0, 0);
+    window_offset = vec2(0.0f, 0.0f);
+    window_scale = vec2(1.0f, 1.0f);
+
+    for (unsigned int i = 0; i < MAX_ACTIONS; i++) {
+        binding_count[i] = 0;
+    }
+    actions = 0;
+    previous_actions = 0;
+}
+
+void Input::begin_frame() {
+    for (unsigned int i = 0; i < KEY_COUNT / 64; i++) {
+        previous_keys[i] = keys[i];
+    }
+    previous_mouse_buttons = mouse_buttons;
+    previous_actions = actions;
+    wheel = ivec2(0, 0);
+}
+
+void Input::handle_event(const InputEvent& event) {
+    switch (event.type) {
+        case InputEvent::KEY_DOWN:
+            if (event.code < KEY_COUNT) {
+                keys[event.code / 64] |= (uint64_t)1 << (event.code % 64);
+            }
+            break;
+        case InputEvent::KEY_UP:
+            if (event.code < KEY_COUNT) {
+                keys[event.code / 64] &= ~((uint64_t)1 << (event.code % 64));
+            }
+            break;
+        case InputEvent::MOUSE_MOTION:
+            window_mouse_position = ivec2(event.x, event.y);
+            break;
+        case InputEvent::MOUSE_BUTTON_DOWN:
+            mouse_buttons |= (uint32_t)1 << (event.code & 31);
+            window_mouse_position = ivec2(event.x, event.y);
+            break;
+        case InputEvent::MOUSE_BUTTON_UP:
+            mouse_buttons &= ~((uint32_t)1 << (event.code & 31));
+            window_mouse_position = ivec2(event.x, event.y);
+            break;
+        case InputEvent::MOUSE_WHEEL:
+            wheel = wheel + ivec2(event.x, event.y);
+            break;
+        default:
+            break;
+    }
+}
+
+void Input::end_frame() {
+    // Resolve every action once so that action queries are a single bit test
+    actions = 0;
+    for (unsigned int action = 0; action < MAX_ACTIONS; action++) {
+        for (unsigned int i = 0; i < binding_count[action]; i++) {
+            const Binding& binding = bindings[action][i];
+            bool down = binding.mouse ? mouse_button_down((uint8_t)binding.code) : key_down((SDL_Scancode)binding.code);
+            if (down) {
+                actions |= (uint64_t)1 << action;
+                break;
+            }
+        }
+    }
+}
+
+void Input::set_window_transform(vec2 offset, vec2 scale) {
+    window_offset = offset;
+    window_scale = scale;
+}
+
+bool Input::key_down(SDL_Scancode key) const {
+    return (keys[key / 64] >> (key % 64)) & 1;
+}
+
+bool Input::key_pressed(SDL_Scancode key) const {
+    return ((keys[key / 64] & ~previous_keys[key / 64]) >> (key % 64)) & 1;
+}
+
+bool Input::key_released(SDL_Scancode key) const {
+    return ((~keys[key / 64] & previous_keys[key / 64]) >> (key % 64)) & 1;
+}
+
+bool Input::mouse_button_down(uint8_t button) const {
+    return (mouse_buttons >> (button & 31)) & 1;
+}
+
+bool Input::mouse_button_pressed(uint8_t button) const {
+    return ((mouse_buttons & ~previous_mouse_buttons) >> (button & 31)) & 1;
+}
+
+bool Input::mouse_button_released(uint8_t button) const {
+    return ((~mouse_buttons & previous_mouse_buttons) >> (button & 31)) & 1;
+}
+
+ivec2 Input::mouse_position() const {
+    return ivec2((int)floorf(((float)window_mouse_position.x - window_offset.x) / window_scale.x), (int)floorf(((float)window_mouse_position.y - window_offset.y) / window_scale.y));
+}
+
+ivec2 Input::mouse_wheel() const {
+    return wheel;
+}
+
+void Input::bind(unsigned int action, Binding binding) {
+    if (action >= MAX_ACTIONS || binding_count[action] == MAX_ACTION_BINDINGS) {
+        printf("Unable to bind action %u, it is out of range or has too many bindings\n", action);
+        return;
+    }
+
+    bindings[action][binding_count[action]] = binding;
+    binding_count[action]++;
+}
+
+void Input::bind_key(unsigned int action, SDL_Scancode key) {
+    bind(action, (Binding) {
+        .mouse = false,
+        .code = (uint16_t)key
+    });
+}
+
+void Input::bind_mouse_button(unsigned int action, uint8_t button) {
+    bind(action, (Binding) {
+        .mouse = true,
+        .code = button
+    });
+}
+
+bool Input::action_down(unsigned int action) const {
+    return (actions >> action) & 1;
+}
+
+bool Input::action_pressed(unsigned int action) const {
+    return ((actions & ~previous_actions) >> action) & 1;
+}
+
+bool Input::action_released(unsigned int action) const {
+    return ((~actions & previous_actions) >> action) & 1;
+}
\ No newline at end of file
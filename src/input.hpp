@@ -0,0 +1,90 @@
+#pragma once
+
+#include "math.hpp"
+
+#include <SDL2/SDL.h>
+#include <cstdint>
+
+namespace siren {
+    // The parts of an SDL event the game uses, small enough to record every frame
+    struct InputEvent {
+        enum Type : uint8_t {
+            QUIT,
+            KEY_DOWN,
+            KEY_UP,
+            MOUSE_MOTION,
+            MOUSE_BUTTON_DOWN,
+            MOUSE_BUTTON_UP,
+            MOUSE_WHEEL
+        };
+
+        Type type;
+        // Nonzero for key repeats
+        uint8_t repeat;
+        // Scancode for key events, button for mouse button events
+        uint16_t code;
+        // Window position for mouse events, scroll amount for wheel events
+        int32_t x;
+        int32_t y;
+    };
+
+    // Returns false for events the game doesn't use
+    bool input_event_from_sdl(const SDL_Event& e, InputEvent* event);
+
+    // Keyboard, mouse and action state for the current frame, kept in bitsets so every query is a bit test
+    class Input {
+    public:
+        static const unsigned int KEY_COUNT = 512;
+        static const unsigned int MAX_ACTIONS = 64;
+        static const unsigned int MAX_ACTION_BINDINGS = 4;
+
+        Input();
+
+        // Called by the engine each frame: begin_frame(), handle_event() for every event, then end_frame()
+        void begin_frame();
+        void handle_event(const InputEvent& event);
+        void end_frame();
+        // Maps window coordinates to screen coordinates as screen = (window - offset) / scale
+        void set_window_transform(vec2 offset, vec2 scale);
+
+        bool key_down(SDL_Scancode key) const;
+        bool key_pressed(SDL_Scancode key) const;
+        bool key_released(SDL_Scancode key) const;
+        bool mouse_button_down(uint8_t button) const;
+        bool mouse_button_pressed(uint8_t button) const;
+        bool mouse_button_released(uint8_t button) const;
+        // Mouse position in screen_width by screen_height space
+        ivec2 mouse_position() const;
+        // Scroll since last frame, positive y is away from the user
+        ivec2 mouse_wheel() const;
+
+        // Actions are game defined ids below MAX_ACTIONS, each bound to up to MAX_ACTION_BINDINGS keys or mouse buttons
+        void bind_key(unsigned int action, SDL_Scancode key);
+        void bind_mouse_button(unsigned int action, uint8_t button);
+        bool action_down(unsigned int action) const;
+        bool action_pressed(unsigned int action) const;
+        bool action_released(unsigned int action) const;
+
+    private:
+        struct Binding {
+            bool mouse;
+            uint16_t code;
+        };
+
+        uint64_t keys[KEY_COUNT / 64];
+        uint64_t previous_keys[KEY_COUNT / 64];
+        uint32_t mouse_buttons;
+        uint32_t previous_mouse_buttons;
+        ivec2 window_mouse_position;
+        ivec2 wheel;
+        vec2 window_offset;
+        vec2 window_scale;
+
+        Binding bindings[MAX_ACTIONS][MAX_ACTION_BINDINGS];
+        unsigned int binding_count[MAX_ACTIONS];
+        uint64_t actions;
+        uint64_t previous_actions;
+
+        void bind(unsigned int action, Binding binding);
+    };
+}
\ No newline at end of file
@@ -0,0 +1,198 @@
+#include "job.hpp"
+
+#include <cstdio>
+#include <system_error>
+
+using namespace siren;
+
+// Index of the deque owned by the current thread. The main thread owns deque 0
+static thread_local unsigned int worker_index = 0;
+
+/* Job deque */
+
+JobDeque::JobDeque() {
+    top.store(0);
+    bottom.store(0);
+}
+
+bool JobDeque::push(const Job& job) {
+    long b = bottom.load(std::memory_order_relaxed);
+    long t = top.load(std::memory_order_acquire);
+    if (b - t >= CAPACITY) {
+        return false;
+    }
+
+    jobs[b & (CAPACITY - 1)] = job;
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+
+    return true;
+}
+
+bool JobDeque::pop(Job* job) {
+    long b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long t = top.load(std::memory_order_relaxed);
+
+    if (t > b) {
+        // Deque was empty
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    *job = jobs[b & (CAPACITY - 1)];
+    if (t == b) {
+        // Last job in the deque, race any thieves for it
+        bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+
+    return true;
+}
+
+bool JobDeque::steal(Job* job) {
+    long t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long b = bottom.load(std::memory_order_acquire);
+
+    if (t >= b) {
+        return false;
+    }
+
+    *job = jobs[t & (CAPACITY - 1)];
+    return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+/* Job system */
+
+bool JobSystem::init(unsigned int worker_thread_count) {
+    running.store(true);
+    pending.store(0);
+
+    // Deque 0 belongs to the main thread, which runs jobs whenever it waits on a counter
+    for (unsigned int i = 0; i < worker_thread_count + 1; i++) {
+        deques.push_back(new JobDeque());
+    }
+    worker_index = 0;
+
+    for (unsigned int i = 1; i < worker_thread_count + 1; i++) {
+        try {
+            threads.push_back(std::thread(&JobSystem::worker_main, this, i));
+        } catch (const std::system_error& e) {
+            printf("Error starting job worker thread: %s\n", e.what());
+            quit();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void JobSystem::quit() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        running.store(false);
+    }
+    sleep_condition.notify_all();
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+
+    for (JobDeque* deque : deques) {
+        delete deque;
+    }
+    deques.clear();
+}
+
+unsigned int JobSystem::worker_count() const {
+    return deques.size();
+}
+
+void JobSystem::run(JobFunction function, void* data, unsigned int begin, unsigned int end, JobCounter* counter) {
+    queue(function, data, begin, end, counter);
+    wake_workers();
+}
+
+void JobSystem::wait(JobCounter* counter) {
+    Job job;
+    while (counter->load(std::memory_order_acquire) != 0) {
+        if (get_job(&job)) {
+            execute(job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::queue(JobFunction function, void* data, unsigned int begin, unsigned int end, JobCounter* counter) {
+    Job job = (Job) {
+        .function = function,
+        .data = data,
+        .begin = begin,
+        .end = end,
+        .counter = counter
+    };
+    counter->fetch_add(1, std::memory_order_relaxed);
+
+    if (deques.empty() || !deques[worker_index]->push(job)) {
+        // No room to queue the job, so run it right away
+        execute(job);
+        return;
+    }
+    pending.fetch_add(1, std::memory_order_release);
+}
+
+void JobSystem::wake_workers() {
+    if (threads.empty()) {
+        return;
+    }
+
+    // Taking the lock makes sure a worker can't miss the wakeup between checking pending and going to sleep
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    sleep_condition.notify_all();
+}
+
+bool JobSystem::get_job(Job* job) {
+    if (deques[worker_index]->pop(job)) {
+        pending.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    unsigned int deque_count = deques.size();
+    for (unsigned int i = 1; i < deque_count; i++) {
+        if (deques[(worker_index + i) % deque_count]->steal(job)) {
+            pending.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void JobSystem::execute(const Job& job) {
+    job.function(job.data, job.begin, job.end);
+    job.counter->fetch_sub(1, std::memory_order_release);
+}
+
+void JobSystem::worker_main(unsigned int index) {
+    worker_index = index;
+
+    Job job;
+    while (running.load(std::memory_order_relaxed)) {
+        if (get_job(&job)) {
+            execute(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleep_condition.wait(lock, [this]() {
+            return !running.load(std::memory_order_relaxed) || pending.load(std::memory_order_acquire) > 0;
+        });
+    }
+}
\ No newline at end of file
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+namespace siren {
+    typedef std::atomic<int> JobCounter;
+
+    typedef void (*JobFunction)(void* data, unsigned int begin, unsigned int end);
+
+    struct Job {
+        JobFunction function;
+        void* data;
+        unsigned int begin;
+        unsigned int end;
+        JobCounter* counter;
+    };
+
+    // Fixed capacity Chase-Lev deque. Only the owning worker calls push() and pop(), any worker may steal()
+    class JobDeque {
+    public:
+        static const long CAPACITY = 4096;
+
+        JobDeque();
+        bool push(const Job& job);
+        bool pop(Job* job);
+        bool steal(Job* job);
+
+    private:
+        std::atomic<long> top;
+        std::atomic<long> bottom;
+        Job jobs[CAPACITY];
+    };
+
+    class JobSystem {
+    public:
+        bool init(unsigned int worker_thread_count);
+        void quit();
+        unsigned int worker_count() const;
+
+        // Queues function(data, begin, end) and increments counter until the job has finished
+        void run(JobFunction function, void* data, unsigned int begin, unsigned int end, JobCounter* counter);
+        // Runs other jobs on the calling thread until counter reaches zero. Jobs may call this to wait on jobs they depend on
+        void wait(JobCounter* counter);
+
+        // Splits [0, count) into batches of batch_size and calls function(begin, end) for each batch across all workers, returns once every batch has finished
+        template<typename F>
+        void parallel_for(unsigned int count, unsigned int batch_size, const F& function) {
+            if (count == 0) {
+                return;
+            }
+            if (count <= batch_size || deques.size() <= 1) {
+                function(0u, count);
+                return;
+            }
+
+            JobCounter counter(0);
+            for (unsigned int begin = 0; begin < count; begin += batch_size) {
+                unsigned int end = begin + batch_size < count ? begin + batch_size : count;
+                queue(&parallel_for_job<F>, (void*)&function, begin, end, &counter);
+            }
+            wake_workers();
+            wait(&counter);
+        }
+
+    private:
+        std::vector<JobDeque*> deques;
+        std::vector<std::thread> threads;
+        std::atomic<bool> running;
+        std::atomic<int> pending;
+        std::mutex sleep_mutex;
+        std::condition_variable sleep_condition;
+
+        template<typename F>
+        static void parallel_for_job(void* data, unsigned int begin, unsigned int end) {
+            (*(const F*)data)(begin, end);
+        }
+
+        void queue(JobFunction function, void* data, unsigned int begin, unsigned int end, JobCounter* counter);
+        void wake_workers();
+        bool get_job(Job* job);
+        void execute(const Job& job);
+        void worker_main(unsigned int index);
+    };
+}
\ No newline at end of file
@@ -6,33 +6,224 @@
 #include "world.hpp"
 #include "engine.hpp"
 
-#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+// Frames to run before the game is expected to stop allocating
+static const unsigned int WARMUP_FRAMES = 120;
+// Frame times to make room for up front when timing a replay, about 30 minutes at 60 fps
+static const unsigned int REPLAY_FRAME_TIMES_RESERVE = 60 * 60 * 30;
+static const unsigned int HUD_LINE_COUNT = 3;
+
+static void print_benchmark_report(std::vector<double>& frame_times) {
+    double total = 0.0;
+    for (double frame_time : frame_times) {
+        total += frame_time;
+    }
+    std::sort(frame_times.begin(), frame_times.end());
+
+    unsigned int frame_count = frame_times.size();
+    printf("Benchmark: %u frames in %.3f s, %.1f fps\n", frame_count, total / 1000.0, frame_count * 1000.0 / total);
+    printf("Frame time ms: mean %.3f p50 %.3f p99 %.3f max %.3f\n", total / frame_count, frame_times[frame_count / 2], frame_times[(frame_count * 99) / 100], frame_times[frame_count - 1]);
+}
+
+static void update_world_job(void* data, unsigned int begin, unsigned int end) {
+    ((World*)data)->update();
+}
+
+int main(int argc, char** argv) {
+    // In pipelined mode the next frame is simulated on a worker while the current one is rendered
+    bool pipelined = false;
+    // Exit with an error if any frame allocates once the game has warmed up
+    bool check_allocations = false;
+    // Run this many frames without the frame limiter, then print frame time statistics and exit
+    unsigned int benchmark_frames = 0;
+    // Simulate with a constant 1/60 second delta
+    bool fixed_timestep = false;
+    // Record input to a replay file, or play one back as fast as possible and print frame time statistics when it ends
+    const char* record_path = nullptr;
+    const char* replay_path = nullptr;
+    // Print how long shaders took to load once startup is done
+    bool shader_report = false;
+    // Print the GPU memory held by each texture, and every live GL object, once resources are loaded
+    bool vram_report = false;
+    // Only redraw the parts of the screen that changed since the last frame
+    bool retained = false;
+    // Draw the day and night cycle and lantern lights
+    bool lighting = false;
+    // Start in a borderless window covering the display
+    bool fullscreen = false;
+    // Post process passes to turn on, by name. Their GPU times are printed on exit
+    std::vector<const char*> post_process_names;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--pipelined") == 0) {
+            pipelined = true;
+        } else if (strcmp(argv[i], "--check-allocations") == 0) {
+            check_allocations = true;
+        } else if (strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc) {
+            benchmark_frames = (unsigned int)atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--fixed-timestep") == 0) {
+            fixed_timestep = true;
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "--shader-report") == 0) {
+            shader_report = true;
+        } else if (strcmp(argv[i], "--vram-report") == 0) {
+            vram_report = true;
+        } else if (strcmp(argv[i], "--retained") == 0) {
+            retained = true;
+        } else if (strcmp(argv[i], "--lighting") == 0) {
+            lighting = true;
+        } else if (strcmp(argv[i], "--fullscreen") == 0) {
+            fullscreen = true;
+        } else if (strcmp(argv[i], "--post-process") == 0 && i + 1 < argc) {
+            post_process_names.push_back(argv[i + 1]);
+            i++;
+        }
+    }
 
-int main() {
     siren::Engine& engine = siren::Engine::instance();
     if (!engine.init("Critter Farm", 640, 360)) {
         return -1;
     }
     engine.set_window_size(1280, 720);
+    if (fullscreen) {
+        engine.set_fullscreen(true);
+    }
 
     if (!resource_init()) {
         return false;
     }
+    if (shader_report) {
+        engine.print_shader_report();
+    }
+    for (const char* name : post_process_names) {
+        unsigned int pass_index;
+        if (!engine.find_post_process_pass(name, &pass_index)) {
+            printf("No post process pass named %s\n", name);
+            return -1;
+        }
+        engine.set_post_process_enabled(pass_index, true);
+    }
+    if (vram_report) {
+        siren::vram_print_report();
+        siren::gpu_print_object_report();
+    }
+
+    if (fixed_timestep) {
+        engine.set_fixed_timestep(1.0f / 60.0f);
+    }
+    engine.set_retained_mode(retained);
+    engine.set_lighting_enabled(lighting);
+    if (record_path != nullptr && !engine.record_replay(record_path)) {
+        return -1;
+    }
+    if (replay_path != nullptr && !engine.play_replay(replay_path)) {
+        return -1;
+    }
 
     World world;
 
+    bool benchmark = benchmark_frames != 0 || replay_path != nullptr;
+    std::vector<double> frame_times;
+    if (benchmark_frames != 0) {
+        engine.set_frame_limiter(false);
+        frame_times.reserve(benchmark_frames);
+    } else if (replay_path != nullptr) {
+        frame_times.reserve(REPLAY_FRAME_TIMES_RESERVE);
+    }
+    Uint64 frame_start = SDL_GetPerformanceCounter();
+
+    int last_hud_width = 0;
+    unsigned int frame = 0;
     while (engine.running) {
         engine.timekeep();
         engine.poll_events();
+        if (engine.input.action_pressed(ACTION_QUIT)) {
+            engine.running = false;
+        }
+        if (engine.input.action_pressed(ACTION_TOGGLE_FULLSCREEN)) {
+            engine.set_fullscreen(!engine.is_fullscreen());
+        }
+
+        if (benchmark) {
+            Uint64 frame_end = SDL_GetPerformanceCounter();
+            if (frame != 0) {
+                frame_times.push_back((double)(frame_end - frame_start) * 1000.0 / (double)SDL_GetPerformanceFrequency());
+            }
+            frame_start = frame_end;
+
+            if (benchmark_frames != 0 && frame_times.size() == benchmark_frames) {
+                print_benchmark_report(frame_times);
+                break;
+            }
+        }
 
-        world.update();
+        frame++;
+        if (check_allocations && frame > WARMUP_FRAMES && engine.frame_stats.heap_allocations != 0) {
+            printf("Steady state frame %u allocated\n", frame);
+            engine.print_allocation_report();
+            return 1;
+        }
+
+        siren::JobCounter update_counter(0);
+        if (pipelined) {
+            engine.jobs.run(update_world_job, &world, 0, 1, &update_counter);
+        } else {
+            world.update();
+            world.swap_snapshots();
+        }
+        world.update_particles();
+
+        siren::Arena& frame_arena = engine.frame_arena();
+        const char* hud_lines[HUD_LINE_COUNT] = {
+            frame_arena.format("FPS: %u", engine.fps),
+            frame_arena.format("Allocations: %lu", engine.frame_stats.heap_allocations),
+            frame_arena.format("Draw calls: %u", engine.frame_stats.draw_calls)
+        };
+        if (retained) {
+            // The HUD is redrawn every frame, over the width of its longest line this frame or last so shorter text doesn't leave old characters behind
+            int hud_width = 0;
+            for (unsigned int line = 0; line < HUD_LINE_COUNT; line++) {
+                hud_width = std::max(hud_width, engine.layout_text(font_small, hud_lines[line]).size.x);
+            }
+            engine.invalidate(siren::ivec2(0, 0), siren::ivec2(std::max(hud_width, last_hud_width), HUD_LINE_COUNT * font_small.line_height));
+            last_hud_width = hud_width;
+            world.invalidate_changes();
+        }
 
         engine.render_clear();
         world.render();
-        engine.render_text(font_small, "FPS: " + std::to_string(engine.fps), siren::vec2(0.0f, 0.0f), siren::COLOR_WHITE);
+        if (lighting) {
+            world.render_lights();
+        }
+        for (unsigned int line = 0; line < HUD_LINE_COUNT; line++) {
+            engine.render_text(font_small, hud_lines[line], siren::vec2(0.0f, (float)(font_small.line_height * line)), siren::COLOR_WHITE);
+        }
 
         engine.render_flip();
+
+        if (pipelined) {
+            engine.jobs.wait(&update_counter);
+            world.swap_snapshots();
+        }
+    }
+
+    if (replay_path != nullptr && !frame_times.empty()) {
+        print_benchmark_report(frame_times);
+    }
+    if (!post_process_names.empty()) {
+        engine.print_post_process_report();
     }
+    resource_quit();
     
     return 0;
 }
\ No newline at end of file
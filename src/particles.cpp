@@ -0,0 +1,247 @@
+#include "particles.hpp"
+
+#include "engine.hpp"
+#include "allocation.hpp"
+
+#include <cstdio>
+#include <algorithm>
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+using namespace siren;
+
+ParticleSystem::ParticleSystem() {
+    for (unsigned int i = 0; i < MAX_EMITTERS; i++) {
+        emitters[i].in_use = false;
+        emitters[i].active = false;
+        emitters[i].count = 0;
+    }
+    random_state = 0x9E3779B9;
+}
+
+bool ParticleSystem::create_emitter(const ParticleEmitterSettings& settings, vec2 position, unsigned int* emitter_index) {
+    SIREN_ALLOCATION_SCOPE("ParticleSystem::create_emitter");
+
+    // Prefer a free emitter whose storage already fits, so a warm pool never has to allocate
+    unsigned int index = MAX_EMITTERS;
+    for (unsigned int i = 0; i < MAX_EMITTERS; i++) {
+        if (emitters[i].in_use) {
+            continue;
+        }
+        if (emitters[i].age.size() >= settings.capacity) {
+            index = i;
+            break;
+        }
+        if (index == MAX_EMITTERS) {
+            index = i;
+        }
+    }
+    if (index == MAX_EMITTERS) {
+        printf("Can't create particle emitter, all %u emitters are in use\n", MAX_EMITTERS);
+        return false;
+    }
+
+    Emitter& emitter = emitters[index];
+    emitter.in_use = true;
+    emitter.active = true;
+    emitter.settings = settings;
+    emitter.position = position;
+    emitter.spawn_accumulator = 0.0f;
+    emitter.count = 0;
+    if (emitter.age.size() < settings.capacity) {
+        emitter.position_x.resize(settings.capacity);
+        emitter.position_y.resize(settings.capacity);
+        emitter.velocity_x.resize(settings.capacity);
+        emitter.velocity_y.resize(settings.capacity);
+        emitter.age.resize(settings.capacity);
+    }
+
+    *emitter_index = index;
+    return true;
+}
+
+void ParticleSystem::destroy_emitter(unsigned int emitter_index) {
+    emitters[emitter_index].in_use = false;
+    emitters[emitter_index].active = false;
+    emitters[emitter_index].count = 0;
+}
+
+void ParticleSystem::set_emitter_position(unsigned int emitter_index, vec2 position) {
+    emitters[emitter_index].position = position;
+}
+
+void ParticleSystem::set_emitter_active(unsigned int emitter_index, bool active) {
+    emitters[emitter_index].active = active;
+    emitters[emitter_index].spawn_accumulator = 0.0f;
+}
+
+void ParticleSystem::burst(unsigned int emitter_index, unsigned int count) {
+    spawn(emitters[emitter_index], count);
+}
+
+void ParticleSystem::update(float delta) {
+    SIREN_ALLOCATION_SCOPE("ParticleSystem::update");
+
+    for (Emitter& emitter : emitters) {
+        if (!emitter.in_use) {
+            continue;
+        }
+
+        integrate(emitter, delta);
+        remove_expired(emitter);
+        if (emitter.active && emitter.settings.rate > 0.0f) {
+            emitter.spawn_accumulator += emitter.settings.rate * delta;
+            unsigned int spawn_count = (unsigned int)emitter.spawn_accumulator;
+            emitter.spawn_accumulator -= (float)spawn_count;
+            spawn(emitter, spawn_count);
+        }
+    }
+}
+
+void ParticleSystem::render() const {
+    SIREN_ALLOCATION_SCOPE("ParticleSystem::render");
+
+    Engine& engine = Engine::instance();
+    Engine::ParticleBatch batches[MAX_EMITTERS];
+    bool drawn[MAX_EMITTERS] = {};
+    for (unsigned int i = 0; i < MAX_EMITTERS; i++) {
+        if (drawn[i] || !emitters[i].in_use || emitters[i].count == 0) {
+            continue;
+        }
+
+        // Gather every later emitter with the same sprite into this draw
+        const Sprite* sprite = emitters[i].settings.sprite;
+        unsigned int batch_count = 0;
+        for (unsigned int j = i; j < MAX_EMITTERS; j++) {
+            const Emitter& emitter = emitters[j];
+            if (drawn[j] || !emitter.in_use || emitter.count == 0 || emitter.settings.sprite != sprite) {
+                continue;
+            }
+            batches[batch_count] = (Engine::ParticleBatch) {
+                .frame = emitter.settings.frame,
+                .position_x = &emitter.position_x[0],
+                .position_y = &emitter.position_y[0],
+                .count = emitter.count
+            };
+            batch_count++;
+            drawn[j] = true;
+        }
+        engine.render_particles(*sprite, batches, batch_count);
+    }
+}
+
+unsigned int ParticleSystem::particle_count() const {
+    unsigned int count = 0;
+    for (const Emitter& emitter : emitters) {
+        count += emitter.count;
+    }
+
+    return count;
+}
+
+bool ParticleSystem::bounds(vec2* bounds_min, vec2* bounds_max) const {
+    bool has_particles = false;
+    for (const Emitter& emitter : emitters) {
+        for (unsigned int i = 0; i < emitter.count; i++) {
+            if (!has_particles) {
+                *bounds_min = vec2(emitter.position_x[i], emitter.position_y[i]);
+                *bounds_max = *bounds_min;
+                has_particles = true;
+            }
+            bounds_min->x = std::min(bounds_min->x, emitter.position_x[i]);
+            bounds_min->y = std::min(bounds_min->y, emitter.position_y[i]);
+            bounds_max->x = std::max(bounds_max->x, emitter.position_x[i]);
+            bounds_max->y = std::max(bounds_max->y, emitter.position_y[i]);
+        }
+    }
+
+    return has_particles;
+}
+
+float ParticleSystem::random_float(float min, float max) {
+    // xorshift32, the top 24 bits fill a float's mantissa
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return min + ((max - min) * (float)(random_state >> 8) / 16777216.0f);
+}
+
+void ParticleSystem::spawn(Emitter& emitter, unsigned int count) {
+    const ParticleEmitterSettings& settings = emitter.settings;
+    unsigned int end = std::min(emitter.count + count, settings.capacity);
+    for (unsigned int i = emitter.count; i < end; i++) {
+        emitter.position_x[i] = emitter.position.x + random_float(-settings.spawn_extent.x, settings.spawn_extent.x);
+        emitter.position_y[i] = emitter.position.y + random_float(-settings.spawn_extent.y, settings.spawn_extent.y);
+        emitter.velocity_x[i] = random_float(settings.velocity_min.x, settings.velocity_max.x);
+        emitter.velocity_y[i] = random_float(settings.velocity_min.y, settings.velocity_max.y);
+        emitter.age[i] = 0.0f;
+    }
+    emitter.count = end;
+}
+
+void ParticleSystem::integrate(Emitter& emitter, float delta) {
+    // Semi-implicit Euler, velocity first. The scalar loop does the same math for the particles left over past a multiple of four
+    float velocity_step_x = emitter.settings.acceleration.x * delta;
+    float velocity_step_y = emitter.settings.acceleration.y * delta;
+    float* position_x = &emitter.position_x[0];
+    float* position_y = &emitter.position_y[0];
+    float* velocity_x = &emitter.velocity_x[0];
+    float* velocity_y = &emitter.velocity_y[0];
+    float* age = &emitter.age[0];
+    unsigned int count = emitter.count;
+    unsigned int i = 0;
+
+#ifdef __SSE2__
+    __m128 delta4 = _mm_set1_ps(delta);
+    __m128 velocity_step_x4 = _mm_set1_ps(velocity_step_x);
+    __m128 velocity_step_y4 = _mm_set1_ps(velocity_step_y);
+    for (; i + 4 <= count; i += 4) {
+        __m128 velocity_x4 = _mm_add_ps(_mm_loadu_ps(velocity_x + i), velocity_step_x4);
+        __m128 velocity_y4 = _mm_add_ps(_mm_loadu_ps(velocity_y + i), velocity_step_y4);
+        _mm_storeu_ps(velocity_x + i, velocity_x4);
+        _mm_storeu_ps(velocity_y + i, velocity_y4);
+        _mm_storeu_ps(position_x + i, _mm_add_ps(_mm_loadu_ps(position_x + i), _mm_mul_ps(velocity_x4, delta4)));
+        _mm_storeu_ps(position_y + i, _mm_add_ps(_mm_loadu_ps(position_y + i), _mm_mul_ps(velocity_y4, delta4)));
+        _mm_storeu_ps(age + i, _mm_add_ps(_mm_loadu_ps(age + i), delta4));
+    }
+#endif
+
+    for (; i < count; i++) {
+        velocity_x[i] += velocity_step_x;
+        velocity_y[i] += velocity_step_y;
+        position_x[i] += velocity_x[i] * delta;
+        position_y[i] += velocity_y[i] * delta;
+        age[i] += delta;
+    }
+}
+
+void ParticleSystem::remove_expired(Emitter& emitter) {
+    // Expired particles are replaced by the last one, so order isn't kept
+    float lifetime = emitter.settings.lifetime;
+    unsigned int i = 0;
+    while (i < emitter.count) {
+#ifdef __SSE2__
+        // Skip four at a time past particles that are all still alive
+        __m128 lifetime4 = _mm_set1_ps(lifetime);
+        while (i + 4 <= emitter.count && _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(&emitter.age[i]), lifetime4)) == 0) {
+            i += 4;
+        }
+        if (i == emitter.count) {
+            break;
+        }
+#endif
+        if (emitter.age[i] < lifetime) {
+            i++;
+            continue;
+        }
+
+        unsigned int last = emitter.count - 1;
+        emitter.position_x[i] = emitter.position_x[last];
+        emitter.position_y[i] = emitter.position_y[last];
+        emitter.velocity_x[i] = emitter.velocity_x[last];
+        emitter.velocity_y[i] = emitter.velocity_y[last];
+        emitter.age[i] = emitter.age[last];
+        emitter.count--;
+    }
+}
\ No newline at end of file
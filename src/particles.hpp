@@ -0,0 +1,75 @@
+#pragma once
+
+#include "math.hpp"
+#include "sprite.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace siren {
+    // How an emitter's particles look and move. Every particle is one frame of sprite and lives for the same number of seconds
+    struct ParticleEmitterSettings {
+        const Sprite* sprite;
+        ivec2 frame;
+        // Particles spawned per second while the emitter is active, zero for emitters that only burst
+        float rate;
+        float lifetime;
+        // Particles spawn anywhere within this far of the emitter's position on each axis
+        vec2 spawn_extent;
+        // Starting velocities are picked between these, in pixels per second
+        vec2 velocity_min;
+        vec2 velocity_max;
+        vec2 acceleration;
+        // Most particles alive at once, spawns past it are dropped
+        unsigned int capacity;
+    };
+
+    // Particles are kept as structure of arrays per emitter so they're integrated four at a time with SSE2
+    // Emitters come from a fixed pool. Their particle storage stays allocated when they're destroyed, so creating emitters during play doesn't allocate once the pool is warm
+    // Only called from the GL thread
+    class ParticleSystem {
+    public:
+        static const unsigned int MAX_EMITTERS = 64;
+
+        ParticleSystem();
+        // Fails if every emitter in the pool is in use
+        bool create_emitter(const ParticleEmitterSettings& settings, vec2 position, unsigned int* emitter_index);
+        // The emitter's particles disappear with it
+        void destroy_emitter(unsigned int emitter_index);
+        void set_emitter_position(unsigned int emitter_index, vec2 position);
+        // Inactive emitters stop spawning, their particles live out their lifetimes
+        void set_emitter_active(unsigned int emitter_index, bool active);
+        // Spawns count particles at once, for splashes and the like
+        void burst(unsigned int emitter_index, unsigned int count);
+        void update(float delta);
+        // Draws every particle in the current view. Emitters that share a sprite go out in one instanced draw
+        void render() const;
+        unsigned int particle_count() const;
+        // Smallest rectangle holding every particle's position, false when there are none
+        bool bounds(vec2* bounds_min, vec2* bounds_max) const;
+
+    private:
+        struct Emitter {
+            bool in_use;
+            bool active;
+            ParticleEmitterSettings settings;
+            vec2 position;
+            // Fraction of a particle owed by rate, carried between updates
+            float spawn_accumulator;
+            unsigned int count;
+            std::vector<float> position_x;
+            std::vector<float> position_y;
+            std::vector<float> velocity_x;
+            std::vector<float> velocity_y;
+            std::vector<float> age;
+        };
+        Emitter emitters[MAX_EMITTERS];
+        // Seeded the same every run, so replays spawn the same particles
+        uint32_t random_state;
+
+        float random_float(float min, float max);
+        void spawn(Emitter& emitter, unsigned int count);
+        static void integrate(Emitter& emitter, float delta);
+        static void remove_expired(Emitter& emitter);
+    };
+}
\ No newline at end of file
@@ -0,0 +1,186 @@
+#include "replay.hpp"
+
+#include <cstring>
+
+using namespace siren;
+
+static const char REPLAY_MAGIC[4] = { 'C', 'R', 'R', 'P' };
+
+/* Little endian helpers */
+
+static void write_u8(FILE* file, uint8_t value) {
+    fputc(value, file);
+}
+
+static void write_u16(FILE* file, uint16_t value) {
+    uint8_t bytes[2] = { (uint8_t)value, (uint8_t)(value >> 8) };
+    fwrite(bytes, 1, 2, file);
+}
+
+static void write_u32(FILE* file, uint32_t value) {
+    uint8_t bytes[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+    fwrite(bytes, 1, 4, file);
+}
+
+static bool read_u8(FILE* file, uint8_t* value) {
+    int c = fgetc(file);
+    if (c == EOF) {
+        return false;
+    }
+    *value = (uint8_t)c;
+
+    return true;
+}
+
+static bool read_u16(FILE* file, uint16_t* value) {
+    uint8_t bytes[2];
+    if (fread(bytes, 1, 2, file) != 2) {
+        return false;
+    }
+    *value = (uint16_t)(bytes[0] | (bytes[1] << 8));
+
+    return true;
+}
+
+static bool read_u32(FILE* file, uint32_t* value) {
+    uint8_t bytes[4];
+    if (fread(bytes, 1, 4, file) != 4) {
+        return false;
+    }
+    *value = (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+
+    return true;
+}
+
+/* Recorder */
+
+ReplayRecorder::ReplayRecorder() {
+    file = nullptr;
+}
+
+ReplayRecorder::~ReplayRecorder() {
+    close();
+}
+
+bool ReplayRecorder::open(const char* path, unsigned int screen_width, unsigned int screen_height) {
+    close();
+    file = fopen(path, "wb");
+    if (file == nullptr) {
+        printf("Error opening replay %s for writing\n", path);
+        return false;
+    }
+
+    fwrite(REPLAY_MAGIC, 1, 4, file);
+    write_u32(file, REPLAY_VERSION);
+    write_u32(file, screen_width);
+    write_u32(file, screen_height);
+
+    return true;
+}
+
+void ReplayRecorder::close() {
+    if (file != nullptr) {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+bool ReplayRecorder::is_open() const {
+    return file != nullptr;
+}
+
+void ReplayRecorder::write_frame(uint32_t time, float delta, const std::vector<InputEvent>& events) {
+    uint32_t delta_bits;
+    memcpy(&delta_bits, &delta, sizeof(delta_bits));
+
+    write_u32(file, time);
+    write_u32(file, delta_bits);
+    write_u16(file, (uint16_t)events.size());
+    for (const InputEvent& event : events) {
+        write_u8(file, event.type);
+        write_u8(file, event.repeat);
+        write_u16(file, event.code);
+        write_u32(file, (uint32_t)event.x);
+        write_u32(file, (uint32_t)event.y);
+    }
+}
+
+/* Player */
+
+ReplayPlayer::ReplayPlayer() {
+    file = nullptr;
+}
+
+ReplayPlayer::~ReplayPlayer() {
+    close();
+}
+
+bool ReplayPlayer::open(const char* path, unsigned int screen_width, unsigned int screen_height) {
+    close();
+    file = fopen(path, "rb");
+    if (file == nullptr) {
+        printf("Error opening replay %s\n", path);
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version;
+    uint32_t replay_screen_width;
+    uint32_t replay_screen_height;
+    if (fread(magic, 1, 4, file) != 4 || memcmp(magic, REPLAY_MAGIC, 4) != 0 || !read_u32(file, &version) || !read_u32(file, &replay_screen_width) || !read_u32(file, &replay_screen_height)) {
+        printf("Error: %s is not a replay file\n", path);
+        close();
+        return false;
+    }
+    if (version != REPLAY_VERSION) {
+        printf("Error: replay %s has version %u, expected %u\n", path, version, REPLAY_VERSION);
+        close();
+        return false;
+    }
+    if (replay_screen_width != screen_width || replay_screen_height != screen_height) {
+        printf("Error: replay %s was recorded at %ux%u, the screen is %ux%u\n", path, replay_screen_width, replay_screen_height, screen_width, screen_height);
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void ReplayPlayer::close() {
+    if (file != nullptr) {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+bool ReplayPlayer::is_open() const {
+    return file != nullptr;
+}
+
+bool ReplayPlayer::read_frame(float* delta, std::vector<InputEvent>* events) {
+    uint32_t time;
+    uint32_t delta_bits;
+    uint16_t event_count;
+    if (!read_u32(file, &time) || !read_u32(file, &delta_bits) || !read_u16(file, &event_count)) {
+        return false;
+    }
+    memcpy(delta, &delta_bits, sizeof(*delta));
+
+    events->clear();
+    for (uint16_t i = 0; i < event_count; i++) {
+        InputEvent event;
+        uint8_t type;
+        uint32_t x;
+        uint32_t y;
+        if (!read_u8(file, &type) || !read_u8(file, &event.repeat) || !read_u16(file, &event.code) || !read_u32(file, &x) || !read_u32(file, &y)) {
+            printf("Error: replay ended partway through a frame\n");
+            return false;
+        }
+        event.type = (InputEvent::Type)type;
+        event.x = (int32_t)x;
+        event.y = (int32_t)y;
+        events->push_back(event);
+    }
+
+    return true;
+}
\ No newline at end of file
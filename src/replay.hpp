@@ -0,0 +1,45 @@
+#pragma once
+
+#include "input.hpp"
+
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+
+namespace siren {
+    /*
+     * Replay files hold the delta time and input events of every frame, so a session can be simulated again exactly
+     * Layout, all values little endian:
+     *     header: "CRRP", uint32 version, uint32 screen width, uint32 screen height
+     *     frame:  uint32 milliseconds since recording started, float32 delta, uint16 event count, then per event
+     *             uint8 type, uint8 repeat, uint16 code, int32 x, int32 y
+     */
+    static const uint32_t REPLAY_VERSION = 1;
+
+    class ReplayRecorder {
+    public:
+        ReplayRecorder();
+        ~ReplayRecorder();
+        bool open(const char* path, unsigned int screen_width, unsigned int screen_height);
+        void close();
+        bool is_open() const;
+        void write_frame(uint32_t time, float delta, const std::vector<InputEvent>& events);
+
+    private:
+        FILE* file;
+    };
+
+    class ReplayPlayer {
+    public:
+        ReplayPlayer();
+        ~ReplayPlayer();
+        bool open(const char* path, unsigned int screen_width, unsigned int screen_height);
+        void close();
+        bool is_open() const;
+        // Returns false once the replay has run out of frames
+        bool read_frame(float* delta, std::vector<InputEvent>* events);
+
+    private:
+        FILE* file;
+    };
+}
\ No newline at end of file
@@ -4,33 +4,86 @@
 #include "math.hpp"
 
 Shader outline_shader;
+Shader color_grading_shader;
+Shader vignette_shader;
+Sprite color_grading_lut;
 
 Font font_small;
+Font font_label;
 
 std::unordered_map<Tile, ivec2> tile_atlas_frame;
 Sprite tileset;
+Sprite tile_outline_sprite;
 
 Sprite ant_sprite;
+Sprite particle_sprite;
 
 bool resource_init() {
     Engine& engine = Engine::instance();
 
     bool success = true;
 
-    success &= engine.load_shader(&outline_shader, "./shader/sprite.vs.glsl", "./shader/outline.fs.glsl");
+    // Critters are outlined from masks built when their sprites load, outline.fs.glsl does the same for sprites without one by sampling every neighbor
+    success &= engine.load_shader(&outline_shader, "./shader/sprite.vs.glsl", "./shader/outline_mask.fs.glsl");
     engine.use_shader(outline_shader);
-    engine.set_shader_uniform("sprite_texture", (unsigned int)0);
-    engine.set_shader_uniform("screen_size", vec2((float)engine.screen_width, (float)engine.screen_height));
+    engine.set_shader_uniform("sprite_texture", 0);
+    engine.set_shader_uniform("palette_texture", 1);
+    engine.set_shader_uniform("outline_mask_texture", 2);
+
+    unsigned int pass_index;
+    success &= color_grading_lut.load("./res/color_grading_lut.png");
+    // Graded colors land between the table's 16 levels, so unlike sprites it's filtered
+    glBindTexture(GL_TEXTURE_2D, color_grading_lut.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    success &= engine.load_shader(&color_grading_shader, "./shader/post_process.vs.glsl", "./shader/color_grading.fs.glsl");
+    if (engine.add_post_process_pass("color_grading", color_grading_shader, &pass_index)) {
+        engine.set_post_process_texture(pass_index, color_grading_lut.texture);
+        engine.set_shader_uniform("lut_texture", 1);
+        engine.set_shader_uniform("grading_strength", 1.0f);
+    }
+    success &= engine.load_shader(&vignette_shader, "./shader/post_process.vs.glsl", "./shader/vignette.fs.glsl");
+    if (engine.add_post_process_pass("vignette", vignette_shader, &pass_index)) {
+        engine.set_shader_uniform("vignette_strength", 0.6f);
+    }
 
     success &= font_small.load("./res/hack.ttf", 10);
+    success &= font_label.load("./res/hack.ttf", 24, Font::RENDERING_SDF);
 
-    success &= tileset.load("./res/tiles.png", Sprite::SPECIFY_FRAME_SIZE, 32, 32);
+    // The tileset is the largest texture and only uses a few colors
+    success &= tileset.load("./res/tiles.png", Sprite::SPECIFY_FRAME_SIZE, 32, 32, true);
     tile_atlas_frame[TILE_DIRT] = ivec2(14, 1);
     tile_atlas_frame[TILE_WATER] = ivec2(15, 1);
+    success &= tile_outline_sprite.load("./res/tile_outline.png", Sprite::SPECIFY_FRAME_COUNT, 1, 1);
 
-    success &= ant_sprite.load("./res/ant.png", Sprite::SPECIFY_FRAME_COUNT, 13, 3);
+    success &= ant_sprite.load("./res/ant.png", Sprite::SPECIFY_FRAME_COUNT, 13, 3, false, true);
     ant_sprite.register_animation(ANT_ANIMATION_IDLE, 3, { ivec2(1, 1), ivec2(2, 1) });
     ant_sprite.register_animation(ANT_ANIMATION_WALK, 10, { ivec2(3, 1), ivec2(4, 1), ivec2(5, 1), ivec2(6, 1) });
 
+    success &= particle_sprite.load("./res/particles.png", Sprite::SPECIFY_FRAME_SIZE, 8, 8);
+
+    engine.input.bind_key(ACTION_QUIT, SDL_SCANCODE_ESCAPE);
+    engine.input.bind_mouse_button(ACTION_SELECT, SDL_BUTTON_LEFT);
+    engine.input.bind_key(ACTION_CAMERA_LEFT, SDL_SCANCODE_LEFT);
+    engine.input.bind_key(ACTION_CAMERA_LEFT, SDL_SCANCODE_A);
+    engine.input.bind_key(ACTION_CAMERA_RIGHT, SDL_SCANCODE_RIGHT);
+    engine.input.bind_key(ACTION_CAMERA_RIGHT, SDL_SCANCODE_D);
+    engine.input.bind_key(ACTION_CAMERA_UP, SDL_SCANCODE_UP);
+    engine.input.bind_key(ACTION_CAMERA_UP, SDL_SCANCODE_W);
+    engine.input.bind_key(ACTION_CAMERA_DOWN, SDL_SCANCODE_DOWN);
+    engine.input.bind_key(ACTION_CAMERA_DOWN, SDL_SCANCODE_S);
+    engine.input.bind_key(ACTION_TOGGLE_FULLSCREEN, SDL_SCANCODE_F11);
+
     return success;
+}
+
+void resource_quit() {
+    color_grading_lut.unload();
+    font_small.unload();
+    font_label.unload();
+    tileset.unload();
+    tile_outline_sprite.unload();
+    ant_sprite.unload();
+    particle_sprite.unload();
 }
\ No newline at end of file
@@ -9,9 +9,17 @@
 using namespace siren;
 
 extern Font font_small;
+// Distance field font for text drawn in the world, it stays sharp at every camera zoom
+extern Font font_label;
 
 extern Shader outline_shader;
 
+// Post process passes, all disabled until turned on with --post-process
+extern Shader color_grading_shader;
+extern Shader vignette_shader;
+// The identity grade, artists paint over a copy of it to make new ones
+extern Sprite color_grading_lut;
+
 enum Tile {
     TILE_NONE,
     TILE_DIRT,
@@ -20,6 +28,7 @@ enum Tile {
 
 extern std::unordered_map<Tile, ivec2> tile_atlas_frame;
 extern Sprite tileset;
+extern Sprite tile_outline_sprite;
 
 enum AntAnimation {
     ANT_ANIMATION_IDLE,
@@ -28,4 +37,19 @@ enum AntAnimation {
 
 extern Sprite ant_sprite;
 
-bool resource_init();
\ No newline at end of file
+// 8x8 particle frames in one row: dust, a water droplet and a seed
+extern Sprite particle_sprite;
+
+enum Action {
+    ACTION_QUIT,
+    ACTION_SELECT,
+    ACTION_CAMERA_LEFT,
+    ACTION_CAMERA_RIGHT,
+    ACTION_CAMERA_UP,
+    ACTION_CAMERA_DOWN,
+    ACTION_TOGGLE_FULLSCREEN
+};
+
+bool resource_init();
+// Must run before the engine shuts down, GPU objects still alive then are reported as leaks
+void resource_quit();
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include "shader_cache.hpp"
+
+#include "allocation.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace siren;
+
+static const char SHADER_CACHE_MAGIC[4] = { 'C', 'R', 'S', 'C' };
+static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+static const uint64_t FNV_PRIME = 1099511628211ull;
+
+// FNV-1a, chaining from a previous hash
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+static uint64_t hash_string(uint64_t hash, const char* string) {
+    // Hashing the terminator too keeps "ab" + "c" distinct from "a" + "bc"
+    return hash_bytes(hash, string, strlen(string) + 1);
+}
+
+/* Little endian helpers */
+
+static void write_u32(FILE* file, uint32_t value) {
+    uint8_t bytes[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+    fwrite(bytes, 1, 4, file);
+}
+
+static bool read_u32(FILE* file, uint32_t* value) {
+    uint8_t bytes[4];
+    if (fread(bytes, 1, 4, file) != 4) {
+        return false;
+    }
+    *value = (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+
+    return true;
+}
+
+/* Shader cache */
+
+ShaderCache::ShaderCache() {
+    enabled = false;
+    driver_hash = FNV_OFFSET_BASIS;
+}
+
+void ShaderCache::init(const char* directory) {
+    enabled = false;
+    if (directory == nullptr) {
+        return;
+    }
+
+    GLint format_count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+    if (format_count == 0) {
+        printf("Shader cache disabled, the GL driver has no program binary formats\n");
+        return;
+    }
+
+    this->directory = directory;
+    driver_hash = FNV_OFFSET_BASIS;
+    static const GLenum DRIVER_STRINGS[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for (unsigned int i = 0; i < 3; i++) {
+        const char* driver_string = (const char*)glGetString(DRIVER_STRINGS[i]);
+        driver_hash = hash_string(driver_hash, driver_string != nullptr ? driver_string : "");
+    }
+    enabled = true;
+}
+
+bool ShaderCache::is_enabled() const {
+    return enabled;
+}
+
+uint64_t ShaderCache::key(const std::string& vertex_source, const std::string& fragment_source) const {
+    uint64_t hash = hash_string(driver_hash, vertex_source.c_str());
+    return hash_string(hash, fragment_source.c_str());
+}
+
+bool ShaderCache::load(uint64_t key, GLuint program) const {
+    SIREN_ALLOCATION_SCOPE("ShaderCache::load");
+
+    if (!enabled) {
+        return false;
+    }
+
+    FILE* file = fopen(entry_path(key).c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version, key_low, key_high, format, length;
+    bool valid = fread(magic, 1, 4, file) == 4 && memcmp(magic, SHADER_CACHE_MAGIC, 4) == 0 &&
+                 read_u32(file, &version) && version == SHADER_CACHE_VERSION &&
+                 read_u32(file, &key_low) && read_u32(file, &key_high) && (((uint64_t)key_high << 32) | key_low) == key &&
+                 read_u32(file, &format) && read_u32(file, &length);
+    std::vector<uint8_t> binary;
+    if (valid) {
+        binary.resize(length);
+        valid = fread(&binary[0], 1, length, file) == length;
+    }
+    fclose(file);
+    if (!valid) {
+        return false;
+    }
+
+    // The driver can still reject a binary, for example after an update that kept the same version string
+    glProgramBinary(program, format, &binary[0], length);
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+
+    return success == GL_TRUE;
+}
+
+void ShaderCache::save(uint64_t key, GLuint program) const {
+    SIREN_ALLOCATION_SCOPE("ShaderCache::save");
+
+    if (!enabled) {
+        return;
+    }
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    std::vector<uint8_t> binary(length);
+    GLenum format;
+    glGetProgramBinary(program, length, nullptr, &format, &binary[0]);
+
+    // Write to a temporary file and rename it into place, so an interrupted write never leaves a truncated entry behind
+    std::string path = entry_path(key);
+    std::string temp_path = path + ".tmp";
+    FILE* file = fopen(temp_path.c_str(), "wb");
+    if (file == nullptr) {
+        printf("Error opening shader cache entry %s for writing\n", temp_path.c_str());
+        return;
+    }
+    fwrite(SHADER_CACHE_MAGIC, 1, 4, file);
+    write_u32(file, SHADER_CACHE_VERSION);
+    write_u32(file, (uint32_t)key);
+    write_u32(file, (uint32_t)(key >> 32));
+    write_u32(file, format);
+    write_u32(file, (uint32_t)length);
+    bool written = fwrite(&binary[0], 1, length, file) == (size_t)length;
+    written &= fclose(file) == 0;
+
+    remove(path.c_str());
+    if (!written || rename(temp_path.c_str(), path.c_str()) != 0) {
+        printf("Error writing shader cache entry %s\n", path.c_str());
+        remove(temp_path.c_str());
+    }
+}
+
+std::string ShaderCache::entry_path(uint64_t key) const {
+    char filename[32];
+    snprintf(filename, sizeof(filename), "%016llx.bin", (unsigned long long)key);
+    return directory + filename;
+}
\ No newline at end of file
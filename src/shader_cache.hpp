@@ -0,0 +1,35 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+
+namespace siren {
+    /*
+     * Keeps linked program binaries on disk so later launches can skip compiling GLSL
+     * Entries are keyed by a hash of both shader sources and the GL vendor, renderer and version strings, so an edited shader or a driver update just misses
+     * File layout, all values little endian: "CRSC", uint32 version, uint64 key, uint32 binary format, uint32 binary length, binary
+     */
+    static const uint32_t SHADER_CACHE_VERSION = 1;
+
+    class ShaderCache {
+    public:
+        ShaderCache();
+        // Must be called with a current GL context. A null directory or a driver without binary formats disables the cache
+        void init(const char* directory);
+        bool is_enabled() const;
+
+        uint64_t key(const std::string& vertex_source, const std::string& fragment_source) const;
+        // Loads the cached binary into program, returns false if there's no usable entry and the program has to be compiled
+        bool load(uint64_t key, GLuint program) const;
+        // The program should be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+        void save(uint64_t key, GLuint program) const;
+
+    private:
+        bool enabled;
+        std::string directory;
+        uint64_t driver_hash;
+
+        std::string entry_path(uint64_t key) const;
+    };
+}
\ No newline at end of file
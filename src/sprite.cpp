@@ -1,60 +1,219 @@
 #include "sprite.hpp"
 
+#include "allocation.hpp"
+#include "vram.hpp"
+
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 #include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <utility>
 
 using namespace siren;
 
-bool Sprite::load(const char* path, Sprite::FrameSizeOption frame_size_option, unsigned int hframes, unsigned int vframes) {
+// Replaces the pixels with indices into at most 256 colors. Returns false, leaving the pixels alone, if the image has more colors than that
+static bool palettize(SpriteImage* image) {
+    std::unordered_map<uint32_t, uint8_t> color_indices;
+    std::vector<uint8_t> indices(image->width * image->height);
+    // Neighboring pixels are usually the same color, so the last lookup is kept to skip most of the hashing
+    uint32_t last_color = 0;
+    uint8_t last_index = 0;
+    bool has_last = false;
+    for (unsigned int i = 0; i < image->width * image->height; i++) {
+        const uint8_t* pixel = &image->pixels[i * 4];
+        // Every fully transparent pixel shares one entry, whatever color it happens to have
+        uint32_t color = pixel[3] == 0 ? 0 : pixel[0] | (pixel[1] << 8) | (pixel[2] << 16) | ((uint32_t)pixel[3] << 24);
+        if (has_last && color == last_color) {
+            indices[i] = last_index;
+            continue;
+        }
+
+        std::unordered_map<uint32_t, uint8_t>::iterator it = color_indices.find(color);
+        if (it == color_indices.end()) {
+            if (color_indices.size() == 256) {
+                return false;
+            }
+            image->palette[color_indices.size()] = color;
+            it = color_indices.insert(std::make_pair(color, (uint8_t)color_indices.size())).first;
+        }
+        indices[i] = it->second;
+        last_color = color;
+        last_index = it->second;
+        has_last = true;
+    }
+
+    for (unsigned int i = color_indices.size(); i < 256; i++) {
+        image->palette[i] = 0;
+    }
+    image->pixels.swap(indices);
+    image->format = GL_RED;
+    image->internal_format = GL_R8;
+    image->bytes_per_pixel = 1;
+    image->has_palette = true;
+
+    return true;
+}
+
+bool SpriteImage::decode(const char* path, bool use_palette) {
+    SIREN_ALLOCATION_SCOPE("SpriteImage::decode");
+
     SDL_Surface* surface = IMG_Load(path);
     if (surface == nullptr) {
         printf("Failed to load image %s\n", path);
         return false;
     }
 
-    GLenum texture_format;
     switch (surface->format->BytesPerPixel) {
         case 1:
-            texture_format = GL_RED;
+            format = GL_RED;
+            internal_format = GL_R8;
             break;
         case 3:
-            texture_format = GL_RGB;
+            format = GL_RGB;
+            internal_format = GL_RGB8;
             break;
         case 4:
-            texture_format = GL_RGBA;
+            format = GL_RGBA;
+            internal_format = GL_RGBA8;
             break;
         default:
             printf("Format of texture %s not recognized\n", path);
+            SDL_FreeSurface(surface);
             return false;
     }
 
+    // Rows are copied out tightly packed, without the surface's padding
     width = surface->w;
     height = surface->h;
-    if (frame_size_option == SPECIFY_FRAME_COUNT) {
-        frame_width = width / hframes;
-        frame_height = height / vframes;
-    } else {
-        frame_width = hframes;
-        frame_height = vframes;
+    bytes_per_pixel = surface->format->BytesPerPixel;
+    has_palette = false;
+    pixels.resize(width * height * bytes_per_pixel);
+    for (unsigned int y = 0; y < height; y++) {
+        memcpy(&pixels[y * width * bytes_per_pixel], (const uint8_t*)surface->pixels + (y * surface->pitch), width * bytes_per_pixel);
     }
+    SDL_FreeSurface(surface);
+
+    // Pixel art rarely uses more than a handful of colors, so RGBA images can usually be palettized
+    if (use_palette && bytes_per_pixel == 4) {
+        palettize(this);
+    }
+
+    return true;
+}
+
+uint8_t SpriteImage::alpha(unsigned int x, unsigned int y) const {
+    unsigned int index = x + (y * width);
+    if (has_palette) {
+        return palette[pixels[index]] >> 24;
+    }
+    return bytes_per_pixel == 4 ? pixels[(index * 4) + 3] : 255;
+}
+
+void SpriteImage::build_outline_mask(unsigned int frame_width, unsigned int frame_height, std::vector<uint8_t>* mask) const {
+    mask->assign(width * height, 0);
+    for (unsigned int y = 0; y < height; y++) {
+        // Neighbors are only looked for within the pixel's own frame, so outlines don't pick up the edges of the next frame over
+        unsigned int frame_top = y - (y % frame_height);
+        unsigned int frame_bottom = std::min(frame_top + frame_height, height);
+        for (unsigned int x = 0; x < width; x++) {
+            unsigned int frame_left = x - (x % frame_width);
+            unsigned int frame_right = std::min(frame_left + frame_width, width);
+
+            unsigned int neighbors = 0;
+            for (int offset_y = -1; offset_y <= 1; offset_y++) {
+                for (int offset_x = -1; offset_x <= 1; offset_x++) {
+                    int neighbor_x = (int)x + offset_x;
+                    int neighbor_y = (int)y + offset_y;
+                    if ((offset_x == 0 && offset_y == 0) || neighbor_x < (int)frame_left || neighbor_x >= (int)frame_right || neighbor_y < (int)frame_top || neighbor_y >= (int)frame_bottom) {
+                        continue;
+                    }
+                    neighbors += alpha(neighbor_x, neighbor_y);
+                }
+            }
 
-    glGenTextures(1, &texture);
+            // Same as the old 8 tap shader: the summed neighbor alpha capped at one, less the pixel's own alpha
+            int coverage = (int)std::min(neighbors, 255u) - (int)alpha(x, y);
+            (*mask)[x + (y * width)] = (uint8_t)std::max(coverage, 0);
+        }
+    }
+}
+
+TextureHandle Sprite::create_texture(const char* name, GLint internal_format, unsigned int width, unsigned int height, GLenum format, const void* pixels) {
+    TextureHandle texture;
+    texture.create(name);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, texture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, texture_format, surface->w, surface->h, 0, texture_format, GL_UNSIGNED_BYTE, surface->pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     glBindTexture(GL_TEXTURE_2D, 0);
 
-    SDL_FreeSurface(surface);
+    return texture;
+}
+
+bool Sprite::load(const char* path, Sprite::FrameSizeOption frame_size_option, unsigned int hframes, unsigned int vframes, bool use_palette, bool outline_mask) {
+    SIREN_ALLOCATION_SCOPE("Sprite::load");
+
+    SpriteImage image;
+    if (!image.decode(path, use_palette)) {
+        return false;
+    }
+
+    attach(path, image, create_texture(path, image.internal_format, image.width, image.height, image.format, &image.pixels[0]), frame_size_option, hframes, vframes, outline_mask);
 
     return true;
 }
 
+void Sprite::attach(const char* path, const SpriteImage& image, TextureHandle texture, FrameSizeOption frame_size_option, unsigned int hframes, unsigned int vframes, bool outline_mask) {
+    this->path = path;
+    width = image.width;
+    height = image.height;
+    if (frame_size_option == SPECIFY_FRAME_COUNT) {
+        frame_width = width / hframes;
+        frame_height = height / vframes;
+    } else {
+        frame_width = hframes;
+        frame_height = vframes;
+    }
+
+    this->texture = std::move(texture);
+    this->texture.set_bytes(width * height * image.bytes_per_pixel);
+    vram_bytes = width * height * image.bytes_per_pixel;
+    palette.reset();
+    if (image.has_palette) {
+        palette = create_texture("Sprite palette", GL_RGBA8, 256, 1, GL_RGBA, image.palette);
+        palette.set_bytes(256 * 4);
+        vram_bytes += 256 * 4;
+    }
+
+    this->outline_mask.reset();
+    if (outline_mask) {
+        std::vector<uint8_t> mask;
+        image.build_outline_mask(frame_width, frame_height, &mask);
+        this->outline_mask = create_texture("Sprite outline mask", GL_R8, width, height, GL_RED, &mask[0]);
+        this->outline_mask.set_bytes(width * height);
+        vram_bytes += width * height;
+    }
+    vram_track(this, this->path.c_str(), vram_bytes);
+}
+
+void Sprite::unload() {
+    texture.reset();
+    palette.reset();
+    outline_mask.reset();
+    vram_bytes = 0;
+    vram_untrack(this);
+}
+
 void Sprite::register_animation(unsigned int animation_name, int fps, const std::initializer_list<ivec2> &frames) {
+    SIREN_ALLOCATION_SCOPE("Sprite::register_animation");
+
     animation_data[animation_name] = (AnimationData) {
         .frames = frames,
         .frame_duration = 1.0f / (float)fps
@@ -1,19 +1,49 @@
 #pragma once
 
 #include "math.hpp"
+#include "gpu_object.hpp"
 
 #include <glad/glad.h>
+#include <cstdint>
+#include <string>
 #include <vector>
 #include <unordered_map>
 
 namespace siren {
+    // An image file decoded to tightly packed rows, ready to upload. Decoding makes no GL calls, so it can run on a worker thread
+    struct SpriteImage {
+        unsigned int width;
+        unsigned int height;
+        GLenum format;
+        GLint internal_format;
+        unsigned int bytes_per_pixel;
+        std::vector<uint8_t> pixels;
+        // When set, pixels are indices into palette
+        bool has_palette;
+        uint32_t palette[256];
+
+        // With use_palette, RGBA images of at most 256 colors are converted to palette indices
+        bool decode(const char* path, bool use_palette);
+        uint8_t alpha(unsigned int x, unsigned int y) const;
+        // One byte per pixel, how much of the outline color covers it. Transparent pixels next to an opaque one in the same frame are fully covered
+        void build_outline_mask(unsigned int frame_width, unsigned int frame_height, std::vector<uint8_t>* mask) const;
+    };
+
     struct Sprite {
         struct AnimationData {
             std::vector<ivec2> frames;
             float frame_duration;
         };
 
-        GLuint texture;
+        // Sprites loaded with use_palette and at most 256 colors are stored as an R8 texture of palette indices plus a 256x1 RGBA palette
+        // That's a quarter of the memory and upload, at the cost of a dependent texture read per sample. Otherwise palette is 0 and texture holds the colors
+        TextureHandle texture;
+        TextureHandle palette;
+        // R8 texture the size of texture, built by build_outline_mask() for outline.fs.glsl. 0 unless the sprite was loaded with outline_mask
+        TextureHandle outline_mask;
+        // GPU memory held by the texture and palette
+        size_t vram_bytes;
+        std::string path;
         unsigned int width;
         unsigned int height;
         unsigned int frame_width;
@@ -24,7 +54,11 @@ namespace siren {
             SPECIFY_FRAME_COUNT,
             SPECIFY_FRAME_SIZE
         };
-        bool load(const char* path, FrameSizeOption frame_size_option = SPECIFY_FRAME_SIZE, unsigned int hframes = 1, unsigned int vframes = 1);
+        bool load(const char* path, FrameSizeOption frame_size_option = SPECIFY_FRAME_SIZE, unsigned int hframes = 1, unsigned int vframes = 1, bool use_palette = false, bool outline_mask = false);
+        // Sets the sprite up around a texture that already holds the image, uploading its palette and outline mask if it has them. Used by load() and TextureStreamer
+        void attach(const char* path, const SpriteImage& image, TextureHandle texture, FrameSizeOption frame_size_option, unsigned int hframes, unsigned int vframes, bool outline_mask);
+        void unload();
+        static TextureHandle create_texture(const char* name, GLint internal_format, unsigned int width, unsigned int height, GLenum format, const void* pixels);
         void register_animation(unsigned int animation_name, int fps, const std::initializer_list<ivec2> &frames); 
     };
 
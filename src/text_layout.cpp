@@ -0,0 +1,206 @@
+#include "text_layout.hpp"
+
+#include "allocation.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+using namespace siren;
+
+static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+static const uint64_t FNV_PRIME = 1099511628211ull;
+
+// FNV-1a, chaining from a previous hash
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/* TextLayout */
+
+uint64_t TextLayout::hash(const Font& font, const char* text, TextAlign align, unsigned int max_width) {
+    const Font* font_pointer = &font;
+    uint64_t hash = FNV_OFFSET_BASIS;
+    hash = hash_bytes(hash, &font_pointer, sizeof(font_pointer));
+    hash = hash_bytes(hash, &align, sizeof(align));
+    hash = hash_bytes(hash, &max_width, sizeof(max_width));
+    return hash_bytes(hash, text, strlen(text));
+}
+
+void TextLayout::build(Font& font, const char* text, TextAlign align, unsigned int max_width, unsigned int frame) {
+    SIREN_ALLOCATION_SCOPE("TextLayout::build");
+
+    struct Line {
+        unsigned int first_quad;
+        unsigned int end_quad;
+        int width;
+    };
+    // Shared by every build, layouts are only built on the GL thread
+    static std::vector<Line> lines;
+
+    this->font = &font;
+    this->text.assign(text);
+    this->align = align;
+    this->max_width = max_width;
+    complete = true;
+    quads.clear();
+    page_mask = 0;
+    lines.clear();
+
+    unsigned int line_start = 0;
+    int pen_x = 0;
+    uint32_t previous = 0;
+    // Where the line can be wrapped, just after the last space
+    bool has_break = false;
+    unsigned int break_quad = 0;
+    int break_pen_x = 0;
+    int break_line_width = 0;
+
+    const char* c = text;
+    while (*c != '\0') {
+        uint32_t codepoint = utf8_next(&c);
+        if (codepoint == '\n') {
+            lines.push_back((Line) { .first_quad = line_start, .end_quad = (unsigned int)quads.size(), .width = pen_x });
+            line_start = quads.size();
+            pen_x = 0;
+            previous = 0;
+            has_break = false;
+            continue;
+        }
+
+        const Font::Glyph* glyph = font.glyph(codepoint, frame);
+        if (glyph == nullptr) {
+            complete = false;
+            continue;
+        }
+
+        int x = pen_x + (previous != 0 ? font.kerning(previous, codepoint) : 0);
+        if (max_width != 0 && codepoint != ' ' && x + glyph->advance > (int)max_width) {
+            if (has_break) {
+                // Move the word in progress down to a new line
+                lines.push_back((Line) { .first_quad = line_start, .end_quad = break_quad, .width = break_line_width });
+                for (unsigned int i = break_quad; i < quads.size(); i++) {
+                    quads[i].dest_position[0] -= break_pen_x;
+                }
+                line_start = break_quad;
+                x -= break_pen_x;
+                has_break = false;
+            } else if (quads.size() != line_start) {
+                // A single word wider than the line is broken wherever it overflows
+                lines.push_back((Line) { .first_quad = line_start, .end_quad = (unsigned int)quads.size(), .width = pen_x });
+                line_start = quads.size();
+                x = 0;
+            }
+        }
+
+        if (glyph->width != 0) {
+            quads.push_back((Quad) {
+                .dest_position = { (int16_t)(x + glyph->offset_x), glyph->offset_y },
+                .source_position = { glyph->x, glyph->y },
+                .size = { glyph->width, glyph->height },
+                .page = glyph->page
+            });
+            page_mask |= 1u << glyph->page;
+        }
+
+        pen_x = x + glyph->advance;
+        previous = codepoint;
+        if (codepoint == ' ') {
+            has_break = true;
+            break_quad = quads.size();
+            break_pen_x = pen_x;
+            break_line_width = x;
+        }
+    }
+    lines.push_back((Line) { .first_quad = line_start, .end_quad = (unsigned int)quads.size(), .width = pen_x });
+
+    size = ivec2(0, (int)(lines.size() * font.line_height));
+    for (const Line& line : lines) {
+        size.x = std::max(size.x, line.width);
+    }
+    line_count = lines.size();
+
+    // Lines are aligned within max_width, or within the widest line when the text doesn't wrap
+    int align_width = max_width != 0 ? (int)max_width : size.x;
+    for (unsigned int line_index = 0; line_index < lines.size(); line_index++) {
+        const Line& line = lines[line_index];
+        int offset_x = 0;
+        if (align == TEXT_ALIGN_CENTER) {
+            offset_x = (align_width - line.width) / 2;
+        } else if (align == TEXT_ALIGN_RIGHT) {
+            offset_x = align_width - line.width;
+        }
+        int offset_y = line_index * font.line_height;
+        for (unsigned int i = line.first_quad; i < line.end_quad; i++) {
+            quads[i].dest_position[0] += offset_x;
+            quads[i].dest_position[1] += offset_y;
+        }
+    }
+
+    // Glyphs rasterized during the build may have evicted pages, the quads only reference pages used this frame so they're still good
+    font_generation = font.generation;
+}
+
+bool TextLayout::is_valid() const {
+    return font != nullptr && complete && font_generation == font->generation;
+}
+
+/* TextLayoutCache */
+
+TextLayoutCache::TextLayoutCache() {
+    clear();
+}
+
+const TextLayout& TextLayoutCache::get(Font& font, const char* text, TextAlign align, unsigned int max_width, unsigned int frame) {
+    uint64_t key = TextLayout::hash(font, text, align, max_width);
+    use_count++;
+
+    unsigned int index = layout_count;
+    for (unsigned int i = 0; i < layout_count; i++) {
+        if (keys[i] == key) {
+            index = i;
+            break;
+        }
+    }
+
+    if (index != layout_count) {
+        // The text is compared too, so a hash collision rebuilds instead of drawing the wrong string
+        const TextLayout& layout = layouts[index];
+        if (layout.is_valid() && layout.font == &font && layout.align == align && layout.max_width == max_width && layout.text == text) {
+            last_used[index] = use_count;
+            hits++;
+            return layout;
+        }
+    } else if (layout_count < MAX_LAYOUTS) {
+        layout_count++;
+    } else {
+        index = 0;
+        for (unsigned int i = 1; i < MAX_LAYOUTS; i++) {
+            if (last_used[i] < last_used[index]) {
+                index = i;
+            }
+        }
+    }
+
+    misses++;
+    layouts[index].build(font, text, align, max_width, frame);
+    keys[index] = key;
+    last_used[index] = use_count;
+
+    return layouts[index];
+}
+
+void TextLayoutCache::clear() {
+    for (unsigned int i = 0; i < MAX_LAYOUTS; i++) {
+        layouts[i].font = nullptr;
+    }
+    layout_count = 0;
+    use_count = 0;
+    hits = 0;
+    misses = 0;
+}
\ No newline at end of file
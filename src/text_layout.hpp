@@ -0,0 +1,72 @@
+#pragma once
+
+#include "math.hpp"
+#include "font.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace siren {
+    enum TextAlign : uint8_t {
+        TEXT_ALIGN_LEFT,
+        TEXT_ALIGN_CENTER,
+        TEXT_ALIGN_RIGHT
+    };
+
+    // A string measured and laid out once into glyph quads, so drawing it again is just copying the quads into the sprite batch
+    // Lines break at newlines, and at spaces once a line would pass max_width. A max_width of zero never wraps
+    struct TextLayout {
+        struct Quad {
+            // Relative to the top left of the layout
+            int16_t dest_position[2];
+            uint16_t source_position[2];
+            uint16_t size[2];
+            uint16_t page;
+        };
+
+        Font* font;
+        std::string text;
+        TextAlign align;
+        unsigned int max_width;
+        // Font::generation when the layout was built, the quads' source positions are stale once it changes
+        uint32_t font_generation;
+        // False when the font ran out of atlas space partway through, so the layout is rebuilt next time instead of reused
+        bool complete;
+
+        std::vector<Quad> quads;
+        // Bit i is set if any quad samples from font page i
+        uint32_t page_mask;
+        // Bounding box of the lines, the width of the widest line by line_count line heights
+        ivec2 size;
+        unsigned int line_count;
+
+        static uint64_t hash(const Font& font, const char* text, TextAlign align, unsigned int max_width);
+        void build(Font& font, const char* text, TextAlign align, unsigned int max_width, unsigned int frame);
+        bool is_valid() const;
+    };
+
+    // The most recently used layouts, looked up by a hash of the font, text and layout options
+    // Entries are recycled in place, so once their strings and quad lists have grown to fit, changing text doesn't allocate
+    class TextLayoutCache {
+    public:
+        static const unsigned int MAX_LAYOUTS = 64;
+
+        TextLayoutCache();
+        // Returns a layout for the text, building it into the least recently used entry if it isn't cached
+        const TextLayout& get(Font& font, const char* text, TextAlign align, unsigned int max_width, unsigned int frame);
+        void clear();
+
+        // Counts since the cache was created, useful for checking that repeated text is being reused
+        unsigned long hits;
+        unsigned long misses;
+
+    private:
+        // Keys are kept apart from the layouts so the lookup scan stays in a few cache lines
+        uint64_t keys[MAX_LAYOUTS];
+        unsigned long last_used[MAX_LAYOUTS];
+        TextLayout layouts[MAX_LAYOUTS];
+        unsigned int layout_count;
+        unsigned long use_count;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,193 @@
+#include "texture_streamer.hpp"
+
+#include "allocation.hpp"
+#include "vram.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+
+using namespace siren;
+
+bool TextureStreamer::init(JobSystem* jobs, size_t frame_budget) {
+    this->jobs = jobs;
+    this->frame_budget = frame_budget;
+    segment = 0;
+    for (unsigned int i = 0; i < RING_SEGMENTS; i++) {
+        segment_fences[i] = 0;
+    }
+
+    ring_buffer.create("Texture upload ring");
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring_buffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, frame_budget * RING_SEGMENTS, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    ring_buffer.set_bytes(frame_budget * RING_SEGMENTS);
+    vram_track(this, "Texture upload ring", frame_budget * RING_SEGMENTS);
+
+    return true;
+}
+
+void TextureStreamer::quit() {
+    for (Request* request : requests) {
+        jobs->wait(&request->counter);
+        delete request;
+    }
+    requests.clear();
+
+    for (unsigned int i = 0; i < RING_SEGMENTS; i++) {
+        if (segment_fences[i] != 0) {
+            glDeleteSync(segment_fences[i]);
+            segment_fences[i] = 0;
+        }
+    }
+    ring_buffer.reset();
+    vram_untrack(this);
+}
+
+void TextureStreamer::decode_job(void* data, unsigned int begin, unsigned int end) {
+    Request* request = (Request*)data;
+    request->decoded = request->image.decode(request->path.c_str(), request->use_palette);
+}
+
+void TextureStreamer::load_sprite(Sprite* sprite, const char* path, Sprite::FrameSizeOption frame_size_option, unsigned int hframes, unsigned int vframes, bool use_palette, bool outline_mask) {
+    SIREN_ALLOCATION_SCOPE("TextureStreamer::load_sprite");
+
+    sprite->texture.reset();
+    sprite->palette.reset();
+    sprite->outline_mask.reset();
+
+    Request* request = new Request();
+    request->sprite = sprite;
+    request->path = path;
+    request->frame_size_option = frame_size_option;
+    request->hframes = hframes;
+    request->vframes = vframes;
+    request->use_palette = use_palette;
+    request->outline_mask = outline_mask;
+    request->decoded = false;
+    request->counter = 0;
+    request->next_row = 0;
+    requests.push_back(request);
+
+    // The main thread only runs jobs while it waits, so without worker threads nothing would pick the decode up. Do it right away instead
+    if (jobs->worker_count() <= 1) {
+        decode_job(request, 0, 1);
+    } else {
+        jobs->run(decode_job, request, 0, 1, &request->counter);
+    }
+}
+
+size_t TextureStreamer::update() {
+    SIREN_ALLOCATION_SCOPE("TextureStreamer::update");
+
+    if (requests.empty()) {
+        return 0;
+    }
+
+    // If the GPU is still reading the segment from RING_SEGMENTS frames ago, skip this frame rather than wait on it
+    GLsync& fence = segment_fences[segment];
+    if (fence != 0) {
+        GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (result == GL_TIMEOUT_EXPIRED) {
+            return 0;
+        }
+        glDeleteSync(fence);
+        fence = 0;
+    }
+
+    // Copy as many whole rows as fit into the segment, oldest requests first. Requests still decoding are passed over
+    size_t segment_offset = segment * frame_budget;
+    size_t used = 0;
+    uint8_t* mapped = nullptr;
+    bands.clear();
+    for (Request* request : requests) {
+        if (request->counter.load(std::memory_order_acquire) != 0 || !request->decoded) {
+            continue;
+        }
+
+        const SpriteImage& image = request->image;
+        size_t row_bytes = image.width * image.bytes_per_pixel;
+        unsigned int row_count = std::min((unsigned int)((frame_budget - used) / row_bytes), image.height - request->next_row);
+        if (row_count == 0) {
+            // Rows wider than a whole segment go straight from the decoded image below
+            if (row_bytes > frame_budget) {
+                bands.push_back((Band) { .request = request, .first_row = request->next_row, .row_count = image.height - request->next_row, .offset = 0 });
+                request->next_row = image.height;
+                continue;
+            }
+            break;
+        }
+
+        if (mapped == nullptr) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring_buffer);
+            mapped = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, segment_offset, frame_budget, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if (mapped == nullptr) {
+                printf("Failed to map texture upload buffer\n");
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                return 0;
+            }
+        }
+        memcpy(mapped + used, &image.pixels[request->next_row * row_bytes], row_count * row_bytes);
+        bands.push_back((Band) { .request = request, .first_row = request->next_row, .row_count = row_count, .offset = segment_offset + used });
+        request->next_row += row_count;
+        used += row_count * row_bytes;
+    }
+
+    if (mapped != nullptr) {
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+
+    for (const Band& band : bands) {
+        Request* request = band.request;
+        const SpriteImage& image = request->image;
+        if (request->texture == 0) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            request->texture = Sprite::create_texture(request->path.c_str(), image.internal_format, image.width, image.height, image.format, nullptr);
+        }
+
+        size_t row_bytes = image.width * image.bytes_per_pixel;
+        bool from_ring = row_bytes <= frame_budget;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, from_ring ? ring_buffer : 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, request->texture);
+        // Rows are tightly packed and bands start at any offset
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        const void* pixels = from_ring ? (const void*)band.offset : (const void*)&image.pixels[band.first_row * row_bytes];
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, band.first_row, image.width, band.row_count, image.format, GL_UNSIGNED_BYTE, pixels);
+        if (!from_ring) {
+            used += band.row_count * row_bytes;
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    if (mapped != nullptr) {
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        segment = (segment + 1) % RING_SEGMENTS;
+    }
+
+    // Hand finished textures to their sprites, and drop requests whose image failed to decode
+    for (unsigned int i = 0; i < requests.size();) {
+        Request* request = requests[i];
+        bool decode_failed = request->counter.load(std::memory_order_acquire) == 0 && !request->decoded;
+        if (decode_failed) {
+            // decode() has already printed why, the sprite's texture stays 0
+        } else if (request->texture != 0 && request->next_row == request->image.height) {
+            request->sprite->attach(request->path.c_str(), request->image, std::move(request->texture), request->frame_size_option, request->hframes, request->vframes, request->outline_mask);
+        } else {
+            i++;
+            continue;
+        }
+
+        delete request;
+        requests.erase(requests.begin() + i);
+    }
+
+    return used;
+}
+
+bool TextureStreamer::idle() const {
+    return requests.empty();
+}
\ No newline at end of file
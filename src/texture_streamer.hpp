@@ -0,0 +1,71 @@
+#pragma once
+
+#include "sprite.hpp"
+#include "job.hpp"
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace siren {
+    // Loads sprites in the background. Images are decoded on the job system, then copied to the GPU a band of rows at a time through a ring of pixel buffers
+    // Each frame uploads at most frame_budget bytes, so a large texture is spread over several frames instead of stalling one
+    // Ring segments are reused only once their fence has signaled, so the driver never has to wait for the GPU to finish reading one before it's overwritten
+    class TextureStreamer {
+    public:
+        static const size_t DEFAULT_FRAME_BUDGET = 256 * 1024;
+        static const unsigned int RING_SEGMENTS = 3;
+
+        bool init(JobSystem* jobs, size_t frame_budget = DEFAULT_FRAME_BUDGET);
+        // Waits for decodes in flight and drops anything still queued
+        void quit();
+
+        // Queues the sprite to load. Until it finishes the sprite's texture is 0 and render_sprite() skips it. The sprite must stay alive until then
+        void load_sprite(Sprite* sprite, const char* path, Sprite::FrameSizeOption frame_size_option = Sprite::SPECIFY_FRAME_SIZE, unsigned int hframes = 1, unsigned int vframes = 1, bool use_palette = false, bool outline_mask = false);
+        // Copies up to the frame budget of decoded rows to the GPU and finishes sprites whose last rows went up. Returns the bytes uploaded
+        // Called once per frame by Engine::render_clear()
+        size_t update();
+        // True once every queued sprite has loaded or failed to
+        bool idle() const;
+
+    private:
+        struct Request {
+            Sprite* sprite;
+            std::string path;
+            Sprite::FrameSizeOption frame_size_option;
+            unsigned int hframes;
+            unsigned int vframes;
+            bool use_palette;
+            bool outline_mask;
+
+            // Written by the decode job, read once counter reaches zero
+            SpriteImage image;
+            bool decoded;
+            JobCounter counter;
+
+            // Created when the first rows go up, deleted with the request if it never finishes
+            TextureHandle texture;
+            // Rows below this one have been uploaded
+            unsigned int next_row;
+        };
+        // Rows copied into the mapped segment, uploaded once the segment is unmapped
+        struct Band {
+            Request* request;
+            unsigned int first_row;
+            unsigned int row_count;
+            size_t offset;
+        };
+
+        JobSystem* jobs;
+        size_t frame_budget;
+        std::vector<Request*> requests;
+        std::vector<Band> bands;
+
+        BufferHandle ring_buffer;
+        GLsync segment_fences[RING_SEGMENTS];
+        unsigned int segment;
+
+        static void decode_job(void* data, unsigned int begin, unsigned int end);
+    };
+}
\ No newline at end of file
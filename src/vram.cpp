@@ -0,0 +1,69 @@
+#include "vram.hpp"
+
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+using namespace siren;
+
+static std::vector<VramAllocation> vram_registry;
+
+static std::vector<VramAllocation>::iterator vram_find(const void* owner) {
+    return std::find_if(vram_registry.begin(), vram_registry.end(), [owner](const VramAllocation& allocation) {
+        return allocation.owner == owner;
+    });
+}
+
+void siren::vram_track(const void* owner, const char* name, size_t bytes) {
+    std::vector<VramAllocation>::iterator it = vram_find(owner);
+    if (it != vram_registry.end()) {
+        it->name = name;
+        it->bytes = bytes;
+        return;
+    }
+
+    vram_registry.push_back((VramAllocation) {
+        .owner = owner,
+        .name = name,
+        .bytes = bytes
+    });
+}
+
+void siren::vram_untrack(const void* owner) {
+    std::vector<VramAllocation>::iterator it = vram_find(owner);
+    if (it != vram_registry.end()) {
+        vram_registry.erase(it);
+    }
+}
+
+size_t siren::vram_used() {
+    size_t total = 0;
+    for (const VramAllocation& allocation : vram_registry) {
+        total += allocation.bytes;
+    }
+
+    return total;
+}
+
+unsigned int siren::vram_allocations(VramAllocation* allocations, unsigned int max_allocations) {
+    std::vector<VramAllocation> sorted = vram_registry;
+    std::sort(sorted.begin(), sorted.end(), [](const VramAllocation& a, const VramAllocation& b) {
+        return a.bytes > b.bytes;
+    });
+
+    unsigned int count = std::min((unsigned int)sorted.size(), max_allocations);
+    std::copy(sorted.begin(), sorted.begin() + count, allocations);
+
+    return count;
+}
+
+void siren::vram_print_report() {
+    static const unsigned int MAX_REPORT_ALLOCATIONS = 64;
+
+    VramAllocation allocations[MAX_REPORT_ALLOCATIONS];
+    unsigned int count = vram_allocations(allocations, MAX_REPORT_ALLOCATIONS);
+    printf("VRAM: %.1f KB in %zu allocations\n", vram_used() / 1024.0, vram_registry.size());
+    for (unsigned int i = 0; i < count; i++) {
+        printf("    %-36s %10.1f KB\n", allocations[i].name, allocations[i].bytes / 1024.0);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+
+namespace siren {
+    // GPU memory accounting. Code that allocates texture or buffer storage records it against an owner, so usage can be broken down per sprite, font and so on
+    // Only called from the GL thread
+    struct VramAllocation {
+        const void* owner;
+        const char* name;
+        size_t bytes;
+    };
+
+    // Sets the bytes held by owner, replacing any earlier amount. name must outlive the allocation
+    void vram_track(const void* owner, const char* name, size_t bytes);
+    void vram_untrack(const void* owner);
+    size_t vram_used();
+    // Writes up to max_allocations allocations, largest first, and returns how many were written
+    unsigned int vram_allocations(VramAllocation* allocations, unsigned int max_allocations);
+    void vram_print_report();
+}
\ No newline at end of file
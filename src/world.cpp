@@ -3,46 +3,416 @@
 #include "resource.hpp"
 #include "engine.hpp"
 
+#include <cmath>
+#include <algorithm>
+
+// Which tile each pixel of a 32x16 cell belongs to. 0 is the diamond inscribed in the cell, 1-4 are its top left, top right, bottom left and bottom right neighbors
+static const unsigned int DIAMOND_MASK_WIDTH = 32;
+static const unsigned int DIAMOND_MASK_HEIGHT = 16;
+static const char* DIAMOND_MASK[DIAMOND_MASK_HEIGHT] = {
+    "11111111111111100222222222222222",
+    "11111111111110000002222222222222",
+    "11111111111000000000022222222222",
+    "11111111100000000000000222222222",
+    "11111110000000000000000002222222",
+    "11111000000000000000000000022222",
+    "11100000000000000000000000000222",
+    "10000000000000000000000000000002",
+    "30000000000000000000000000000004",
+    "33300000000000000000000000000444",
+    "33333000000000000000000000044444",
+    "33333330000000000000000004444444",
+    "33333333300000000000000444444444",
+    "33333333333000000000044444444444",
+    "33333333333330000004444444444444",
+    "33333333333333300444444444444444"
+};
+// Map offset of each mask region from the cell's own tile
+static const int DIAMOND_MASK_OFFSET[5][2] = { { 0, 0 }, { -1, 0 }, { 0, -1 }, { 0, 1 }, { 1, 0 } };
+
+// Camera panning speed in screen pixels per second
+static const float CAMERA_PAN_SPEED = 240.0f;
+// World pixels the camera can scroll past the edge of the map
+static const float CAMERA_MARGIN = 64.0f;
+
+// The top vertex of a tile's diamond face, relative to the top left of its sprite frame
+static const int TILE_FACE_X = 16;
+static const int TILE_FACE_Y = 8;
+// Size of the hovered tile's coordinate label in world pixels
+static const float TILE_LABEL_SIZE = 8.0f;
+
+// Seconds of game time for a full day and night, starting at noon
+static const float DAY_LENGTH = 120.0f;
+static const siren::Color NIGHT_AMBIENT = siren::Color(40, 50, 90);
+// Lanterns only show once the daylight fades, lighting a radius in world pixels around the center of their tile's face
+static const float LANTERN_RADIUS = 40.0f;
+static const siren::Color LANTERN_COLOR = siren::Color(255, 180, 100);
+
+// Frames of particle_sprite
+static const ivec2 PARTICLE_FRAME_DUST = ivec2(0, 0);
+static const ivec2 PARTICLE_FRAME_DROPLET = ivec2(1, 0);
+static const ivec2 PARTICLE_FRAME_SEED = ivec2(2, 0);
+// Particles burst out when a water or dirt tile is clicked
+static const unsigned int SPLASH_PARTICLE_COUNT = 16;
+static const unsigned int SEED_PARTICLE_COUNT = 8;
+
 World::World() {
     for (unsigned int i = 0; i < MAP_WIDTH * MAP_WIDTH; i++) {
         map[i] = TILE_WATER;
     }
     map_set_tile(ivec2(1, 1), TILE_DIRT);
     map_set_tile(ivec2(1, 2), TILE_DIRT);
+    lanterns.push_back(ivec2(1, 1));
+    lanterns.push_back(ivec2(3, 3));
 
-    camera_offset = vec2(64.0f, 64.0f);
+    // Every emitter is made up front, so clicking tiles during play never allocates
+    vec2 face_offset = vec2((float)TILE_FACE_X, (float)(TILE_FACE_Y + (DIAMOND_MASK_HEIGHT / 2)));
+    siren::ParticleEmitterSettings dust = (siren::ParticleEmitterSettings) {
+        .sprite = &particle_sprite,
+        .frame = PARTICLE_FRAME_DUST,
+        .rate = 4.0f,
+        .lifetime = 1.5f,
+        .spawn_extent = vec2(8.0f, 3.0f),
+        .velocity_min = vec2(-4.0f, -12.0f),
+        .velocity_max = vec2(4.0f, -6.0f),
+        .acceleration = vec2(0.0f, 4.0f),
+        .capacity = 8
+    };
+    for (unsigned int i = 0; i < MAP_WIDTH * MAP_WIDTH; i++) {
+        if (map[i] == TILE_DIRT) {
+            unsigned int dust_emitter;
+            particles.create_emitter(dust, map_to_world(ivec2(i % MAP_WIDTH, i / MAP_WIDTH)) + face_offset, &dust_emitter);
+        }
+    }
+    siren::ParticleEmitterSettings splash = (siren::ParticleEmitterSettings) {
+        .sprite = &particle_sprite,
+        .frame = PARTICLE_FRAME_DROPLET,
+        .rate = 0.0f,
+        .lifetime = 0.6f,
+        .spawn_extent = vec2(3.0f, 1.0f),
+        .velocity_min = vec2(-30.0f, -80.0f),
+        .velocity_max = vec2(30.0f, -40.0f),
+        .acceleration = vec2(0.0f, 200.0f),
+        .capacity = SPLASH_PARTICLE_COUNT * 4
+    };
+    particles.create_emitter(splash, vec2(0.0f, 0.0f), &splash_emitter);
+    siren::ParticleEmitterSettings seeds = splash;
+    seeds.frame = PARTICLE_FRAME_SEED;
+    seeds.lifetime = 0.4f;
+    seeds.velocity_min = vec2(-20.0f, -50.0f);
+    seeds.velocity_max = vec2(20.0f, -30.0f);
+    seeds.capacity = SEED_PARTICLE_COUNT * 4;
+    particles.create_emitter(seeds, vec2(0.0f, 0.0f), &seed_emitter);
+    has_drawn_particles = false;
+
+    vec2 bounds_min, bounds_max;
+    map_world_bounds(&bounds_min, &bounds_max);
+    camera.set_bounds(bounds_min - vec2(CAMERA_MARGIN, CAMERA_MARGIN), bounds_max + vec2(CAMERA_MARGIN, CAMERA_MARGIN));
+    camera.snap_to_target();
+
+    critters.push_back((Critter) {
+        .position = vec2(64.0f, 64.0f),
+        .animation = siren::SpriteAnimation(&ant_sprite),
+        .selected = false
+    });
+
+    has_hovered_tile = false;
+    hovered_tile = ivec2(0, 0);
+    selection_start = ivec2(0, 0);
 
-    ant_animation = siren::SpriteAnimation(&ant_sprite);
+    front_snapshot = 0;
+    extract_snapshot(&snapshots[front_snapshot]);
+    has_drawn_snapshot = false;
 }
 
 void World::update() {
+    SIREN_ALLOCATION_SCOPE("World::update");
+
     siren::Engine& engine = siren::Engine::instance();
+    float delta = engine.delta;
+
+    ivec2 mouse_position = engine.input.mouse_position();
 
-    ant_animation.update(ANT_ANIMATION_WALK, engine.delta);
+    vec2 pan_direction = vec2(0.0f, 0.0f);
+    if (engine.input.action_down(ACTION_CAMERA_LEFT)) {
+        pan_direction.x -= 1.0f;
+    }
+    if (engine.input.action_down(ACTION_CAMERA_RIGHT)) {
+        pan_direction.x += 1.0f;
+    }
+    if (engine.input.action_down(ACTION_CAMERA_UP)) {
+        pan_direction.y -= 1.0f;
+    }
+    if (engine.input.action_down(ACTION_CAMERA_DOWN)) {
+        pan_direction.y += 1.0f;
+    }
+    camera.pan(pan_direction * (CAMERA_PAN_SPEED * delta));
+    if (engine.input.mouse_wheel().y != 0) {
+        camera.zoom_at(engine.input.mouse_wheel().y > 0 ? 1 : -1, vec2((float)mouse_position.x, (float)mouse_position.y));
+    }
+    camera.update(delta);
+
+    hovered_tile = screen_to_map(mouse_position);
+    has_hovered_tile = map_in_bounds(hovered_tile);
+
+    if (engine.input.action_pressed(ACTION_SELECT)) {
+        selection_start = mouse_position;
+    }
+    if (engine.input.action_released(ACTION_SELECT)) {
+        selection.clear();
+        critters_in_screen_rect(selection_start, mouse_position, &selection);
+        for (Critter& critter : critters) {
+            critter.selected = false;
+        }
+        for (unsigned int index : selection) {
+            critters[index].selected = true;
+        }
+    }
+
+    // Critters don't touch each other's state, so they can be simulated in parallel batches
+    engine.jobs.parallel_for(critters.size(), CRITTER_BATCH_SIZE, [this, delta](unsigned int begin, unsigned int end) {
+        SIREN_ALLOCATION_SCOPE("World::update");
+        for (unsigned int i = begin; i < end; i++) {
+            critters[i].animation.update(ANT_ANIMATION_WALK, delta);
+        }
+    });
+
+    extract_snapshot(&snapshots[1 - front_snapshot]);
+}
+
+void World::swap_snapshots() {
+    front_snapshot = 1 - front_snapshot;
+}
+
+void World::update_particles() {
+    SIREN_ALLOCATION_SCOPE("World::update_particles");
+
+    siren::Engine& engine = siren::Engine::instance();
+    const Snapshot& snapshot = snapshots[front_snapshot];
+
+    // The front snapshot's hovered tile is the one on screen, and a pipelined update() never writes it
+    if (engine.input.action_pressed(ACTION_SELECT) && snapshot.has_hovered_tile) {
+        Tile tile = snapshot.map[snapshot.hovered_tile.x + (snapshot.hovered_tile.y * MAP_WIDTH)];
+        vec2 face_center = map_to_world(snapshot.hovered_tile) + vec2((float)TILE_FACE_X, (float)(TILE_FACE_Y + (DIAMOND_MASK_HEIGHT / 2)));
+        if (tile == TILE_WATER) {
+            particles.set_emitter_position(splash_emitter, face_center);
+            particles.burst(splash_emitter, SPLASH_PARTICLE_COUNT);
+        } else if (tile == TILE_DIRT) {
+            particles.set_emitter_position(seed_emitter, face_center);
+            particles.burst(seed_emitter, SEED_PARTICLE_COUNT);
+        }
+    }
+    particles.update(engine.delta);
+}
+
+void World::invalidate_changes() {
+    SIREN_ALLOCATION_SCOPE("World::invalidate_changes");
+
+    siren::Engine& engine = siren::Engine::instance();
+    const Snapshot& snapshot = snapshots[front_snapshot];
+    const Snapshot& drawn = drawn_snapshot;
+
+    // Camera movement shifts everything, and critters being added or removed is rare enough not to track individually
+    vec2 view_offset = snapshot.camera.view_offset();
+    vec2 drawn_view_offset = drawn.camera.view_offset();
+    if (!has_drawn_snapshot || view_offset.x != drawn_view_offset.x || view_offset.y != drawn_view_offset.y || snapshot.camera.zoom != drawn.camera.zoom || snapshot.critters.size() != drawn.critters.size()) {
+        engine.invalidate_all();
+    } else {
+        for (unsigned int i = 0; i < MAP_WIDTH * MAP_WIDTH; i++) {
+            if (snapshot.map[i] != drawn.map[i]) {
+                invalidate_world_rect(snapshot.camera, map_to_world(ivec2(i % MAP_WIDTH, i / MAP_WIDTH)), vec2((float)tileset.frame_width, (float)tileset.frame_height));
+            }
+        }
+
+        if (snapshot.has_hovered_tile != drawn.has_hovered_tile || snapshot.hovered_tile.x != drawn.hovered_tile.x || snapshot.hovered_tile.y != drawn.hovered_tile.y) {
+            invalidate_hovered_tile(drawn);
+            invalidate_hovered_tile(snapshot);
+        }
+
+        for (unsigned int i = 0; i < snapshot.critters.size(); i++) {
+            const Snapshot::CritterState& critter = snapshot.critters[i];
+            const Snapshot::CritterState& drawn_critter = drawn.critters[i];
+            if (critter.position.x == drawn_critter.position.x && critter.position.y == drawn_critter.position.y && critter.sprite == drawn_critter.sprite &&
+                    critter.frame.x == drawn_critter.frame.x && critter.frame.y == drawn_critter.frame.y &&
+                    critter.flip_h == drawn_critter.flip_h && critter.flip_v == drawn_critter.flip_v && critter.selected == drawn_critter.selected) {
+                continue;
+            }
+            invalidate_world_rect(snapshot.camera, drawn_critter.position, vec2((float)drawn_critter.sprite->frame_width, (float)drawn_critter.sprite->frame_height));
+            invalidate_world_rect(snapshot.camera, critter.position, vec2((float)critter.sprite->frame_width, (float)critter.sprite->frame_height));
+        }
+
+        // Particles move most frames, so one rectangle around all of them is cheaper than tracking each
+        if (has_drawn_particles) {
+            invalidate_world_rect(snapshot.camera, drawn_particles_min, drawn_particles_max - drawn_particles_min);
+        }
+    }
+    invalidate_particles();
+
+    // Assigning keeps drawn_snapshot's critter capacity, so this only allocates when the critter count grows
+    drawn_snapshot = snapshot;
+    has_drawn_snapshot = true;
+}
+
+void World::invalidate_world_rect(const siren::Camera& camera, vec2 position, vec2 size) const {
+    vec2 screen_min = camera.world_to_screen(position);
+    vec2 screen_max = camera.world_to_screen(position + size);
+    ivec2 min = ivec2((int)floorf(screen_min.x) - 1, (int)floorf(screen_min.y) - 1);
+    ivec2 max = ivec2((int)ceilf(screen_max.x) + 1, (int)ceilf(screen_max.y) + 1);
+    siren::Engine::instance().invalidate(min, max - min);
+}
+
+void World::invalidate_particles() {
+    // Positions are the centers of the particle frames
+    has_drawn_particles = particles.bounds(&drawn_particles_min, &drawn_particles_max);
+    if (!has_drawn_particles) {
+        return;
+    }
+    vec2 half_frame = vec2((float)(particle_sprite.frame_width / 2), (float)(particle_sprite.frame_height / 2));
+    drawn_particles_min = drawn_particles_min - half_frame;
+    drawn_particles_max = drawn_particles_max + half_frame;
+    invalidate_world_rect(snapshots[front_snapshot].camera, drawn_particles_min, drawn_particles_max - drawn_particles_min);
+}
+
+void World::invalidate_hovered_tile(const Snapshot& snapshot) const {
+    if (!snapshot.has_hovered_tile) {
+        return;
+    }
+
+    // The outline sprite plus the label above it, which is no wider than the tile
+    vec2 tile_position = map_to_world(snapshot.hovered_tile);
+    float label_height = (float)font_label.line_height * TILE_LABEL_SIZE / (float)font_label.size;
+    float top = std::min(0.0f, (float)TILE_FACE_Y - label_height);
+    float width = (float)std::max(tile_outline_sprite.frame_width, tileset.frame_width);
+    invalidate_world_rect(snapshot.camera, tile_position + vec2(0.0f, top), vec2(width, (float)tile_outline_sprite.frame_height - top));
+}
+
+void World::extract_snapshot(Snapshot* snapshot) const {
+    for (unsigned int i = 0; i < MAP_WIDTH * MAP_WIDTH; i++) {
+        snapshot->map[i] = map[i];
+    }
+    snapshot->camera = camera;
+    snapshot->has_hovered_tile = has_hovered_tile;
+    snapshot->hovered_tile = hovered_tile;
+
+    // resize() keeps the old capacity, so this only allocates when the critter count grows
+    snapshot->critters.resize(critters.size());
+    for (unsigned int i = 0; i < critters.size(); i++) {
+        const siren::SpriteAnimation& animation = critters[i].animation;
+        Snapshot::CritterState& state = snapshot->critters[i];
+        state.position = critters[i].position;
+        state.sprite = animation.sprite;
+        state.frame = animation.sprite->animation_data.at(animation.animation).frames[animation.frame];
+        state.flip_h = animation.flip_h;
+        state.flip_v = animation.flip_v;
+        state.selected = critters[i].selected;
+    }
 }
 
 void World::render() {
+    SIREN_ALLOCATION_SCOPE("World::render");
+
+    siren::Engine& engine = siren::Engine::instance();
+    const Snapshot& snapshot = snapshots[front_snapshot];
+
+    // Record the map and critters in parallel batches, then replay them in draw order on this thread
+    map_commands.resize((MAP_ROW_COUNT + MAP_ROW_BATCH_SIZE - 1) / MAP_ROW_BATCH_SIZE);
+    engine.jobs.parallel_for(MAP_ROW_COUNT, MAP_ROW_BATCH_SIZE, [this, &snapshot](unsigned int begin, unsigned int end) {
+        record_map_rows(snapshot, begin, end, &map_commands[begin / MAP_ROW_BATCH_SIZE]);
+    });
+
+    critter_commands.resize((snapshot.critters.size() + CRITTER_BATCH_SIZE - 1) / CRITTER_BATCH_SIZE);
+    engine.jobs.parallel_for(snapshot.critters.size(), CRITTER_BATCH_SIZE, [this, &snapshot](unsigned int begin, unsigned int end) {
+        record_critters(snapshot, begin, end, &critter_commands[begin / CRITTER_BATCH_SIZE]);
+    });
+
+    // Everything is recorded in world space, the camera is applied by the view uniform block
+    engine.set_camera(snapshot.camera);
+    engine.use_view(siren::Engine::VIEW_WORLD);
+    for (const siren::CommandBuffer& commands : map_commands) {
+        engine.submit(commands);
+    }
+    particles.render();
+    if (snapshot.has_hovered_tile) {
+        vec2 tile_position = map_to_world(snapshot.hovered_tile);
+        engine.render_sprite(tile_outline_sprite, tile_position);
+
+        // The label sits just above the tile's face, centered across the frame
+        float label_height = (float)font_label.line_height * TILE_LABEL_SIZE / (float)font_label.size;
+        const char* label = engine.frame_arena().format("%d, %d", snapshot.hovered_tile.x, snapshot.hovered_tile.y);
+        engine.render_text(font_label, label, tile_position + vec2(0.0f, (float)TILE_FACE_Y - label_height), COLOR_WHITE, TEXT_ALIGN_CENTER, tileset.frame_width, TILE_LABEL_SIZE);
+    }
+    engine.use_shader(outline_shader);
+    for (const siren::CommandBuffer& commands : critter_commands) {
+        engine.submit(commands);
+    }
+    engine.use_view(siren::Engine::VIEW_SCREEN);
+}
+
+void World::render_lights() const {
+    SIREN_ALLOCATION_SCOPE("World::render_lights");
+
     siren::Engine& engine = siren::Engine::instance();
 
-    // Render map
-    for (unsigned int row = 0; row < (MAP_WIDTH * 2) - 1; row++) {
+    // 1 at noon and 0 at midnight
+    float daylight = 0.5f + (0.5f * cosf(engine.time * 2.0f * (float)M_PI / DAY_LENGTH));
+    siren::Color ambient;
+    ambient.r = NIGHT_AMBIENT.r + ((1.0f - NIGHT_AMBIENT.r) * daylight);
+    ambient.g = NIGHT_AMBIENT.g + ((1.0f - NIGHT_AMBIENT.g) * daylight);
+    ambient.b = NIGHT_AMBIENT.b + ((1.0f - NIGHT_AMBIENT.b) * daylight);
+    engine.set_ambient_light(ambient);
+    if (daylight == 1.0f) {
+        return;
+    }
+
+    siren::Color lantern_color;
+    lantern_color.r = LANTERN_COLOR.r * (1.0f - daylight);
+    lantern_color.g = LANTERN_COLOR.g * (1.0f - daylight);
+    lantern_color.b = LANTERN_COLOR.b * (1.0f - daylight);
+    engine.use_view(siren::Engine::VIEW_WORLD);
+    for (ivec2 lantern : lanterns) {
+        vec2 face_center = map_to_world(lantern) + vec2((float)TILE_FACE_X, (float)(TILE_FACE_Y + (DIAMOND_MASK_HEIGHT / 2)));
+        engine.render_light(face_center, LANTERN_RADIUS, lantern_color);
+    }
+    engine.use_view(siren::Engine::VIEW_SCREEN);
+}
+
+void World::record_map_rows(const Snapshot& snapshot, unsigned int begin, unsigned int end, siren::CommandBuffer* commands) const {
+    SIREN_ALLOCATION_SCOPE("World::record_map_rows");
+
+    commands->clear();
+
+    for (unsigned int row = begin; row < end; row++) {
         ivec2 coordinate = row < MAP_WIDTH ? ivec2(0, row) : ivec2(row - (MAP_WIDTH - 1), MAP_WIDTH - 1);
         unsigned int row_size = row < MAP_WIDTH ? coordinate.y + 1 : MAP_WIDTH - coordinate.x;
         for (unsigned int col = 0; col < row_size; col++) {
-            Tile tile = map_get_tile(coordinate);
+            Tile tile = snapshot.map[coordinate.x + (coordinate.y * MAP_WIDTH)];
             if (tile != TILE_NONE) {
-                ivec2 tile_frame = tile_atlas_frame[tile];
-                engine.render_sprite(tileset, map_to_world(coordinate) + camera_offset, (unsigned int)tile_frame.x, (unsigned int)tile_frame.y);
+                const ivec2& tile_frame = tile_atlas_frame.at(tile);
+                commands->render_sprite(tileset, map_to_world(coordinate), (unsigned int)tile_frame.x, (unsigned int)tile_frame.y);
             }
 
             coordinate.x++;
             coordinate.y--;
         }
     }
+}
 
-    engine.use_shader(outline_shader);
-    engine.set_shader_uniform("show_outline", true);
-    engine.render_sprite_animation(ant_animation, siren::vec2(64, 64));
+void World::record_critters(const Snapshot& snapshot, unsigned int begin, unsigned int end, siren::CommandBuffer* commands) const {
+    SIREN_ALLOCATION_SCOPE("World::record_critters");
+
+    commands->clear();
+
+    // Only selected critters are outlined, so the uniform is only set when it changes
+    bool show_outline = snapshot.critters[begin].selected;
+    commands->set_shader_uniform("show_outline", show_outline);
+    for (unsigned int i = begin; i < end; i++) {
+        const Snapshot::CritterState& critter = snapshot.critters[i];
+        if (critter.selected != show_outline) {
+            show_outline = critter.selected;
+            commands->set_shader_uniform("show_outline", show_outline);
+        }
+        commands->render_sprite(*critter.sprite, critter.position, critter.frame.x, critter.frame.y, critter.flip_h, critter.flip_v);
+    }
 }
 
 Tile World::map_get_tile(ivec2 coordinate) const {
@@ -55,4 +425,65 @@ void World::map_set_tile(ivec2 coordinate, Tile value) {
 
 vec2 World::map_to_world(const ivec2 map_coordinate) const {
     return (vec2(16.0f, 8.0f) * map_coordinate.x) + (vec2(-16.0f, 8.0f) * map_coordinate.y);
+}
+
+bool World::map_in_bounds(ivec2 coordinate) const {
+    return coordinate.x >= 0 && coordinate.y >= 0 && coordinate.x < (int)MAP_WIDTH && coordinate.y < (int)MAP_WIDTH;
+}
+
+void World::map_world_bounds(vec2* bounds_min, vec2* bounds_max) const {
+    // The left, right and bottom corners of the map are tiles 0,W-1 and W-1,0 and W-1,W-1
+    *bounds_min = vec2(map_to_world(ivec2(0, MAP_WIDTH - 1)).x, 0.0f);
+    *bounds_max = map_to_world(ivec2(MAP_WIDTH - 1, 0)) + vec2((float)tileset.frame_width, 0.0f);
+    bounds_max->y = map_to_world(ivec2(MAP_WIDTH - 1, MAP_WIDTH - 1)).y + (float)tileset.frame_height;
+}
+
+ivec2 World::screen_to_map(ivec2 screen_position) const {
+    // Zoom is a whole number and the view offset is on the screen pixel grid, so every screen pixel lands inside exactly one world pixel
+    vec2 world_position = camera.screen_to_world(vec2((float)screen_position.x, (float)screen_position.y));
+
+    // Position relative to the top vertex of tile 0,0, shifted so that tile 0,0 is inscribed in cell 0,0
+    int x = (int)floorf(world_position.x) - TILE_FACE_X + (DIAMOND_MASK_WIDTH / 2);
+    int y = (int)floorf(world_position.y) - TILE_FACE_Y;
+
+    // Floored division, so that cells left of or above the origin are negative
+    int cell_x = x >= 0 ? x / (int)DIAMOND_MASK_WIDTH : ((x + 1) / (int)DIAMOND_MASK_WIDTH) - 1;
+    int cell_y = y >= 0 ? y / (int)DIAMOND_MASK_HEIGHT : ((y + 1) / (int)DIAMOND_MASK_HEIGHT) - 1;
+    int local_x = x - (cell_x * (int)DIAMOND_MASK_WIDTH);
+    int local_y = y - (cell_y * (int)DIAMOND_MASK_HEIGHT);
+
+    int region = DIAMOND_MASK[local_y][local_x] - '0';
+    return ivec2(cell_x + cell_y + DIAMOND_MASK_OFFSET[region][0], cell_y - cell_x + DIAMOND_MASK_OFFSET[region][1]);
+}
+
+void World::screen_to_map(const ivec2* screen_positions, ivec2* map_coordinates, unsigned int count) const {
+    for (unsigned int i = 0; i < count; i++) {
+        map_coordinates[i] = screen_to_map(screen_positions[i]);
+    }
+}
+
+vec2 World::screen_to_map_position(vec2 screen_position) const {
+    // Inverse of map_to_world, each tile is 32 pixels wide and 16 tall
+    vec2 world_position = camera.screen_to_world(screen_position);
+    float x = (world_position.x - (float)TILE_FACE_X) / 32.0f;
+    float y = (world_position.y - (float)TILE_FACE_Y) / 16.0f;
+    return vec2(y + x, y - x);
+}
+
+void World::critters_in_screen_rect(ivec2 corner_a, ivec2 corner_b, std::vector<unsigned int>* indices) const {
+    vec2 top_left = camera.screen_to_world(vec2((float)std::min(corner_a.x, corner_b.x), (float)std::min(corner_a.y, corner_b.y)));
+    vec2 bottom_right = camera.screen_to_world(vec2((float)std::max(corner_a.x, corner_b.x) + 1.0f, (float)std::max(corner_a.y, corner_b.y) + 1.0f));
+    float left = top_left.x;
+    float right = bottom_right.x;
+    float top = top_left.y;
+    float bottom = bottom_right.y;
+
+    for (unsigned int i = 0; i < critters.size(); i++) {
+        const Critter& critter = critters[i];
+        float critter_right = critter.position.x + (float)critter.animation.sprite->frame_width;
+        float critter_bottom = critter.position.y + (float)critter.animation.sprite->frame_height;
+        if (critter.position.x < right && critter_right > left && critter.position.y < bottom && critter_bottom > top) {
+            indices->push_back(i);
+        }
+    }
 }
\ No newline at end of file
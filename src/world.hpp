@@ -2,20 +2,118 @@
 
 #include "sprite.hpp"
 #include "resource.hpp"
+#include "command_buffer.hpp"
+#include "camera.hpp"
+#include "particles.hpp"
+
+#include <vector>
+
+struct Critter {
+    vec2 position;
+    siren::SpriteAnimation animation;
+    bool selected;
+};
 
 struct World {
     static const unsigned int MAP_WIDTH = 4;
+    static const unsigned int MAP_ROW_COUNT = (MAP_WIDTH * 2) - 1;
+    // Number of critters each job updates or records draws for
+    static const unsigned int CRITTER_BATCH_SIZE = 256;
+    // Number of diamond rows of the map each render job records
+    static const unsigned int MAP_ROW_BATCH_SIZE = 8;
+
+    // Everything render() needs from a simulated frame, so the next frame can be simulated while this one is drawn
+    struct Snapshot {
+        struct CritterState {
+            vec2 position;
+            const siren::Sprite* sprite;
+            ivec2 frame;
+            bool flip_h;
+            bool flip_v;
+            bool selected;
+        };
+
+        Tile map[MAP_WIDTH * MAP_WIDTH];
+        siren::Camera camera;
+        bool has_hovered_tile;
+        ivec2 hovered_tile;
+        std::vector<CritterState> critters;
+    };
+
     Tile map[MAP_WIDTH * MAP_WIDTH];
 
-    vec2 camera_offset;
+    siren::Camera camera;
+
+    std::vector<Critter> critters;
+
+    // Map tiles with a lantern on them
+    std::vector<ivec2> lanterns;
+
+    // Dust drifting off the dirt tiles, plus splashes and seeds where tiles are clicked
+    siren::ParticleSystem particles;
 
-    siren::SpriteAnimation ant_animation;
+    // Map tile under the mouse, updated each frame
+    bool has_hovered_tile;
+    ivec2 hovered_tile;
 
     World();
     void update();
     void render();
+    void swap_snapshots();
+    // Particles aren't part of the snapshots, they're stepped on the render thread so a pipelined update() never races render()
+    // Call it each frame before invalidate_changes() and render()
+    void update_particles();
+    // Sets the ambient light for the time of day and adds the lantern lights. Call after render() with lighting enabled
+    void render_lights() const;
+    // For retained mode, invalidates whatever the next render() will draw differently from the last one. Call it before Engine::render_clear()
+    void invalidate_changes();
 
     Tile map_get_tile(ivec2 coordinate) const;
     void map_set_tile(ivec2 coordinate, Tile value);
     vec2 map_to_world(const ivec2 map_coordinate) const;
+    bool map_in_bounds(ivec2 coordinate) const;
+    // World space rectangle covered by the map's tile sprites
+    void map_world_bounds(vec2* bounds_min, vec2* bounds_max) const;
+
+    /* Picking, screen positions are in screen_width by screen_height space such as Input::mouse_position() and go through the camera */
+
+    // Exact map coordinate of the tile whose top face covers the screen pixel, which may be out of bounds
+    ivec2 screen_to_map(ivec2 screen_position) const;
+    void screen_to_map(const ivec2* screen_positions, ivec2* map_coordinates, unsigned int count) const;
+    // Continuous map position of a screen point, the fractional part is the position within the tile
+    vec2 screen_to_map_position(vec2 screen_position) const;
+    // Appends the index of every critter whose sprite overlaps the screen rectangle between the two corners
+    void critters_in_screen_rect(ivec2 corner_a, ivec2 corner_b, std::vector<unsigned int>* indices) const;
+
+private:
+    // Where the current box selection started
+    ivec2 selection_start;
+    std::vector<unsigned int> selection;
+
+    // update() writes the back snapshot, render() reads the front one
+    Snapshot snapshots[2];
+    unsigned int front_snapshot;
+
+    // Render traversal is recorded into these by jobs and then submitted in order
+    std::vector<siren::CommandBuffer> map_commands;
+    std::vector<siren::CommandBuffer> critter_commands;
+
+    // The snapshot invalidate_changes() last compared against, so it matches what's on screen
+    Snapshot drawn_snapshot;
+    bool has_drawn_snapshot;
+    // World space rectangle the particles covered when last drawn
+    bool has_drawn_particles;
+    vec2 drawn_particles_min;
+    vec2 drawn_particles_max;
+
+    unsigned int splash_emitter;
+    unsigned int seed_emitter;
+
+    void extract_snapshot(Snapshot* snapshot) const;
+    // Invalidates a world space rectangle as seen through the camera, padded by a pixel to cover rounding
+    void invalidate_world_rect(const siren::Camera& camera, vec2 position, vec2 size) const;
+    void invalidate_hovered_tile(const Snapshot& snapshot) const;
+    void invalidate_particles();
+    void record_map_rows(const Snapshot& snapshot, unsigned int begin, unsigned int end, siren::CommandBuffer* commands) const;
+    void record_critters(const Snapshot& snapshot, unsigned int begin, unsigned int end, siren::CommandBuffer* commands) const;
 };
\ No newline at end of file